@@ -1,4 +1,5 @@
 //INCLUDES
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,10 +8,30 @@
 #include <limits.h>
 #include <ctype.h>
 #include <assert.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <glob.h>
+#include <setjmp.h>
 
 //DEFINES
 #define TRUE 1
 #define FALSE 0
+#define HASH_SEED 2166136261u
+#define HASH_PRIME 16777619u
+#define HASH_SEED_64 14695981039346656037ull
+#define HASH_PRIME_64 1099511628211ull
+#define SPECIFICITY_ID (1 << 20)
+#define SPECIFICITY_CLASS (1 << 10)
+#define SPECIFICITY_TYPE 1
+#define SPECIFICITY_MAX 1023
+#define PARSE_RELEASED 0
+#define PARSE_OWNED_NODE 1
+#define PARSE_OWNED_BLOCK 2
+#define PATCH_HISTORY 64
 //END DEFINES
 
 //ENUMS
@@ -42,6 +63,7 @@ typedef enum {
   TokenType_Astrix,
   TokenType_Slash,
   TokenType_Global_Selector,
+  TokenType_Import,
   TokenType_WhiteSpace,
   TokenType_EOF,
   TokenType_Unknown
@@ -61,7 +83,9 @@ typedef enum {
   NodeType_String,
   NodeType_Identifier,
   NodeType_Expression,
-  NodeType_Term
+  NodeType_Term,
+  NodeType_Stylesheet,
+  NodeType_Import
 } NodeType;
 //END ENUMS
 
@@ -105,27 +129,230 @@ typedef struct _LinkedListNode {
 typedef struct {
   struct _SyntaxNode* property;
   struct _SyntaxNode* expression;
+  int important;
 } Declaration;
 
 typedef struct _Selector {
   struct _SyntaxNode* simpleSelector;
   struct _SyntaxNode* combinator;
   struct _Selector* selector;
+  int specificity;
 } Selector;
+
+typedef struct {
+  Selector* selector;
+  struct _SyntaxNode* ruleset;
+  int important;
+  int order;
+  int selectorIndex;
+} CascadeEntry;
+
+typedef struct {
+  CascadeEntry* entries;
+  int length;
+} CascadeIndex;
+
+typedef struct {
+  char* chars;
+  int length;
+  int capacity;
+} Buffer;
+
+typedef struct {
+  int* order;
+  int* groupStart;
+  int* cyclic;
+  int groups;
+} EvaluationPlan;
+
+typedef struct {
+  int* edgeStart;
+  int* edges;
+  int* index;
+  int* lowLink;
+  int* onStack;
+  int* stack;
+  int stackLength;
+  int nextIndex;
+  EvaluationPlan* plan;
+} PlanState;
+
+typedef struct {
+  struct _SyntaxNode* stylesheet;
+  CascadeIndex cascade;
+  EvaluationPlan* plans;
+  char** ruleIds;
+  int* rankStart;
+  int* ranks;
+  int version;
+} Build;
+
+
+typedef struct {
+  const char* chars;
+  int length;
+} Slice;
+
+typedef struct {
+  void** items;
+  unsigned int* hashes;
+  int capacity;
+  int length;
+} InternTable;
+
+typedef struct {
+  void** keys;
+  int* values;
+  int capacity;
+  int length;
+} PointerMap;
+
+typedef struct {
+  char* path;
+  char* outputPath;
+  unsigned long long hash;
+  struct timespec modifiedTime;
+  off_t modifiedSize;
+  int* imports;
+  int importCount;
+  struct _SyntaxNode* stylesheet;
+  Build build;
+  int hasBuild;
+  int known;
+  int changed;
+  int visited;
+  int watched;
+  int state;
+  int refreshed;
+  int stale;
+} SourceFile;
+
+typedef struct {
+  SourceFile* files;
+  int length;
+  int capacity;
+  PointerMap paths;
+  int failed;
+  char** missing;
+  int missingCount;
+  int missingCapacity;
+} Project;
+
+typedef struct {
+  long nodes[NodeType_Import + 1];
+  long nodeBytes[NodeType_Import + 1];
+  long selectors;
+  long selectorBytes;
+  long declarations;
+  long declarationBytes;
+  long strings;
+  long stringBytes;
+  long listBytes;
+  long tableBytes;
+  long buildBytes;
+  long inputBytes;
+  long inputPeakBytes;
+  long totalBytes;
+} MemoryReport;
+
+typedef struct {
+  PointerMap classes;
+  PointerMap ids;
+  char** names;
+  int* isClass;
+  int* firstWithKey;
+  int nameCount;
+  Selector** selectors;
+  int** subjectNames;
+  int* nextWithKey;
+  int* exact;
+  int selectorCount;
+  CascadeIndex* cascade;
+  int* rankStart;
+  int* ranks;
+  int* declarationStart;
+  int declarationCount;
+} Validator;
+
+typedef struct {
+  long* hits;
+  unsigned char* seen;
+  int* names;
+  int nameCount;
+  int nameCapacity;
+  long* applied;
+  long* wins;
+  struct _SyntaxNode** claimed;
+  int* claimedRank;
+  int* claimedDeclaration;
+  int claimedCount;
+  int claimedCapacity;
+} ValidationCounts;
+
+typedef struct {
+  int* tasks;
+  long top;
+  long bottom;
+} WorkDeque;
+
+typedef struct {
+  Validator validator;
+  char** paths;
+  int fileCount;
+  Buffer* warnings;
+  int* warningCounts;
+  long* hits;
+  unsigned char* seen;
+  long* applied;
+  long* wins;
+  WorkDeque* deques;
+  int threads;
+} ValidationPool;
+
+typedef struct {
+  ValidationPool* pool;
+  int id;
+} ValidationWorker;
+
+typedef struct {
+  int rulesets;
+  int selectors;
+  int combinators;
+  int attributes;
+  int declarations;
+  int pages;
+  int elements;
+  int vocabulary;
+  unsigned int seed;
+} GeneratorOptions;
+
+typedef struct {
+  void** pointers;
+  int* kinds;
+  int length;
+  int capacity;
+} ParseLog;
+
+typedef struct {
+  const char* label;
+  const char* resultsPath;
+  long bytes;
+} BenchRun;
 //END STRUCTS
 
 //TOKEN TABLE
 Token tokens[] = {
   {TokenType_Pound, "#"},
+  {TokenType_Import, "@import"},
   {TokenType_Left_Bracket, "["},
   {TokenType_Right_Bracket, "]"},
   {TokenType_Semi_Colon, ";"},
   {TokenType_Equals_Equals, "=="},
   {TokenType_Equals, "="},
   {TokenType_Colon, ":"},
+  {TokenType_Contains_Value, "*="},
   {TokenType_Global_Selector, "*"},
   {TokenType_Class_Selector, "."},
-  {TokenType_Contains_Value, "*="},
   {TokenType_Contains_Value_In_Dash_List, "|="},
   {TokenType_Contains_Value_In_Space_List, "~="},
   {TokenType_Value_Ends_With, "$="},
@@ -144,13 +371,31 @@ Token tokens[] = {
 Token token_eof = {TokenType_EOF, ""};
 //END TOKEN TABLE
 
+//INTERN TABLES
+InternTable stringTable = {NULL, NULL, 0, 0};
+InternTable nodeTable = {NULL, NULL, 0, 0};
+InternTable declarationTable = {NULL, NULL, 0, 0};
+InternTable selectorTable = {NULL, NULL, 0, 0};
+//END INTERN TABLES
+
+//PARSE RECOVERY
+jmp_buf* parseRecovery = NULL;
+ParseLog parseLog = {NULL, NULL, 0, 0};
+//END PARSE RECOVERY
+
+//MEMORY COUNTERS
+long inputBytes = 0;
+long inputPeakBytes = 0;
+//END MEMORY COUNTERS
+
 //FUNCTION DECLARATION
 int verifyPath(char const* path, int writePath);
 int fileExists(char const* path, int writePath);
 int lastIndexOf(char const* string, char ch);
 int checkFileEnding(char const* path);
 int handleVerificationErrors(int errorCode, char const* path);
-int haveFilesChanged(char const* path);
+int haveFilesChanged(Project* project);
+struct timespec readModifiedTime(struct stat* info);
 int printWatchingFiles();
 int printDetectedChanges(char const* path);
 int checkForCompilationErrors(char const* path);
@@ -186,10 +431,122 @@ SyntaxNode* readCombinator(TokenStream* stream);
 SyntaxNode* readAllDeclarationsInRuleSet(TokenStream* stream);
 SyntaxNode* readAllSelectorsInRuleSet(TokenStream* stream);
 SyntaxNode* readExpression(TokenStream* stream);
+SyntaxNode* readProduct(TokenStream* stream);
 SyntaxNode* readTerm(TokenStream* stream);
 SyntaxNode* readFunction(TokenStream* stream);
+SyntaxNode* readStylesheet(TokenStream* stream);
+SyntaxNode* readImports(TokenStream* stream);
 Declaration* readDeclaration(TokenStream* stream);
 Selector* readSelector(TokenStream* stream);
+unsigned int hashBytes(unsigned int hash, const void* bytes, int length);
+unsigned int hashPointer(unsigned int hash, const void* pointer);
+unsigned long long hashBytes64(unsigned long long hash, const void* bytes, int length);
+void growInternTable(InternTable* table);
+void** findInternSlot(InternTable* table, unsigned int hash, const void* key, int (*matches)(const void* key, const void* item));
+void fillInternSlot(InternTable* table, void** slot, unsigned int hash, void* item);
+char* internString(char* chars, int length);
+SyntaxNode* internNode(SyntaxNode* node);
+Declaration* internDeclaration(Declaration* declaration);
+Selector* internSelector(Selector* selector);
+int getPointerMap(PointerMap* map, const void* key, int fallback);
+void putPointerMap(PointerMap* map, const void* key, int value);
+void freePointerMap(PointerMap* map);
+void optimizeStylesheet(SyntaxNode* stylesheet);
+SyntaxNode* dropOverriddenDeclarations(SyntaxNode* declarations);
+void mergeIdenticalRulesets(SyntaxNode* stylesheet);
+SyntaxNode* mergeSelectorLists(SyntaxNode** rulesets, int* nextMember, int survivor, PointerMap* seen);
+int addSpecificity(int specificity, int amount);
+int combineSpecificity(int left, int right);
+int readSpecificity(SyntaxNode* simpleSelector);
+CascadeIndex buildCascadeIndex(SyntaxNode* stylesheet);
+int compareCascadeEntries(const void* a, const void* b);
+EvaluationPlan planDeclarations(SyntaxNode* declarations);
+int collectReferences(SyntaxNode* expression, PointerMap* properties, int* references, int offset);
+void connectDeclaration(PlanState* state, int declaration);
+void freeEvaluationPlan(EvaluationPlan* plan);
+void writePlan(Buffer* buffer, EvaluationPlan* plan);
+Build buildStylesheet(SyntaxNode* stylesheet, int version);
+int buildProject(Project* project, char const* inputPath, char const* outputPath, int incremental);
+void forgetVisitedFiles(Project* project);
+void addMissingPath(Project* project, char const* path);
+void clearMissingPaths(Project* project);
+int addSourceFile(Project* project, char* path);
+int findSourceFile(Project* project, char const* path);
+int loadSourceFile(Project* project, char const* path);
+int resolveImports(Project* project, int index);
+int findImportCycle(Project* project, int index, int* stack, int depth);
+int refreshSourceFile(Project* project, int index, int incremental, int* rebuilt);
+int flattenSourceFile(Project* project, int index, int* included, void** rulesets, int length);
+SyntaxNode* parseSourceFile(TokenStream* tokenStream, char const* path);
+void parseError(const char* format, ...);
+void logParseAllocation(void* pointer, int kind);
+void freeParseAllocations();
+void resetParseLog();
+void loadDependencyGraph(Project* project, char const* path);
+void saveDependencyGraph(Project* project, char const* path);
+void freeStylesheet(SyntaxNode* stylesheet);
+void freeBuild(Build* build);
+void freeTokenStream(TokenStream* stream);
+void markNode(PointerMap* marks, SyntaxNode* node);
+void markSelector(PointerMap* marks, Selector* selector);
+void releaseNode(void* item);
+int sweepInternTable(InternTable* table, PointerMap* marks, void (*release)(void* item));
+int reclaimProject(Project* project);
+void countNode(MemoryReport* report, PointerMap* counted, SyntaxNode* node);
+MemoryReport measureMemory(Project* project);
+void printMemoryReport(MemoryReport* report);
+char** assignRuleIds(SyntaxNode* stylesheet);
+void assignCascadeRanks(Build* build);
+int haveRanksChanged(Build* previous, int before, Build* next, int after);
+void writeRank(Buffer* buffer, int rank);
+void appendBuffer(Buffer* buffer, const char* chars, int length);
+void appendString(Buffer* buffer, const char* chars);
+void appendQuoted(Buffer* buffer, const char* chars);
+void writeSimpleSelector(Buffer* buffer, SyntaxNode* node);
+void writeSelector(Buffer* buffer, Selector* selector);
+void writeSelectorList(Buffer* buffer, SyntaxNode* selectors);
+void writeExpression(Buffer* buffer, SyntaxNode* node);
+void writeRule(Buffer* buffer, Build* build, int index);
+int emitStylesheet(char const* path, Build* build);
+int emitPatch(char const* path, Build* previous, Build* next);
+int writeOutput(char const* path, char const* mode, Buffer* buffer);
+char* defaultOutputPath(char const* path);
+char* patchOutputPath(char const* path, char const* version);
+void removePatchFile(char const* path, int version);
+void removePatchFiles(char const* path);
+Validator buildValidator(SyntaxNode* stylesheet, CascadeIndex* cascade);
+void freeValidator(Validator* validator);
+ValidationCounts createValidationCounts(Validator* validator);
+void freeValidationCounts(ValidationCounts* counts);
+char* lookupString(const char* chars, int length);
+int checkHtmlName(Validator* validator, char const* name, const char* chars, int length, int isClass, Buffer* warnings);
+void countElement(Validator* validator, ValidationCounts* counts);
+void claimDeclarations(Validator* validator, ValidationCounts* counts, int rank);
+void addElementName(ValidationCounts* counts, int name);
+int validateHtml(Validator* validator, char const* name, const char* chars, int length, Buffer* warnings, ValidationCounts* counts);
+int runValidation(char const* inputPath, int argc, char const* argv[], int index);
+int popWork(WorkDeque* deque);
+int stealWork(WorkDeque* deque);
+void* runValidationWorker(void* argument);
+void validateHtmlFile(ValidationPool* pool, int task, ValidationCounts* counts);
+TokenStream* readDocument(FILE* file);
+SyntaxNode* loadProjectStylesheet(Project* project, char const* inputPath);
+unsigned int nextRandom(unsigned int* state);
+void appendFormat(Buffer* buffer, const char* format, ...);
+void generateCompound(Buffer* buffer, GeneratorOptions* options, unsigned int* state);
+void generateSelector(Buffer* buffer, GeneratorOptions* options, unsigned int* state);
+void generateDeclarations(Buffer* buffer, GeneratorOptions* options, int ruleset);
+void generateStylesheet(Buffer* buffer, GeneratorOptions* options, long targetBytes);
+void generatePage(Buffer* buffer, GeneratorOptions* options, int page);
+GeneratorOptions defaultGeneratorOptions();
+int readGeneratorOption(GeneratorOptions* options, int argc, char const* argv[], int index);
+int generateCorpus(char const* directory, GeneratorOptions* options);
+double currentSeconds();
+int resetPeakMemory();
+long peakMemory();
+void recordStage(BenchRun* run, char const* stage, long bytes, double seconds);
+void benchStage(BenchRun* run, GeneratorOptions* options, char const* stage);
+int runBenchmarks(int argc, char const* argv[]);
 //END FUNCTION DECLARATION
 
 char* nodeTypeToString(NodeType type) {
@@ -214,6 +571,18 @@ char* nodeTypeToString(NodeType type) {
       return "NodeType_Ruleset";
     case NodeType_Declaration:
       return "NodeType_Declaration";
+    case NodeType_Stylesheet:
+      return "NodeType_Stylesheet";
+    case NodeType_Import:
+      return "NodeType_Import";
+    case NodeType_Simple_Selector:
+      return "NodeType_Simple_Selector";
+    case NodeType_Combinator:
+      return "NodeType_Combinator";
+    case NodeType_Expression:
+      return "NodeType_Expression";
+    case NodeType_Term:
+      return "NodeType_Term";
     default:
       return "NodeType_Unknown";
   }
@@ -222,24 +591,79 @@ char* nodeTypeToString(NodeType type) {
 void print(SyntaxNode* node) {
   if (node != NULL) {
     printf("%s\n", nodeTypeToString(node -> type));
+    if (node -> type == NodeType_Stylesheet) {
+      for (int i = 0; i < node -> list.length; i++) {
+        print((SyntaxNode*)node -> list.items[i]);
+      }
+    }
     print(node -> left);
     print(node -> right);
   }
 }
 
 int main(int argc, char const* argv[]) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    return runBenchmarks(argc, argv);
+  }
+  if (argc > 2 && strcmp(argv[1], "--generate") == 0) {
+    GeneratorOptions options = defaultGeneratorOptions();
+    for (int i = 3; i < argc; i += 2) {
+      if (!readGeneratorOption(&options, argc, argv, i)) {
+        printf("Unknown Generator Option \"%s\". Exiting...\n", argv[i]);
+        return 1;
+      }
+    }
+    return generateCorpus(argv[2], &options) ? 0 : 1;
+  }
+
   const char* inputPath = argv[1];
   int isValidInputPath = verifyPath(inputPath, FALSE);
-  SyntaxNode* root = (SyntaxNode*)malloc(sizeof(SyntaxNode));
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--validate") == 0) {
+      return runValidation(inputPath, argc, argv, i);
+    }
+  }
+  char* outputPath = NULL;
+  int watch = TRUE;
+  int report = FALSE;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--once") == 0) {
+      watch = FALSE;
+    } else if (strcmp(argv[i], "--memory") == 0) {
+      report = TRUE;
+    } else {
+      outputPath = (char*)argv[i];
+    }
+  }
+  if (outputPath == NULL) {
+    outputPath = defaultOutputPath(inputPath);
+  }
 
-  FILE * file = fopen(inputPath, "r");
-  TokenStream* tokenStream = readFile(file);
+  Project project = {NULL, 0, 0, {NULL, NULL, 0, 0}, FALSE, NULL, 0, 0};
+  int built = buildProject(&project, inputPath, outputPath, FALSE);
+  if (built && watch) {
+    reclaimProject(&project);
+  }
+  if (report) {
+    MemoryReport memory = measureMemory(&project);
+    printMemoryReport(&memory);
+  }
+  if (!watch) {
+    return built ? 0 : 1;
+  }
 
   printWatchingFiles();
-
-  root = readRuleset(tokenStream);
-  printf("\n");
-  print(root);
+  while (TRUE) {
+    sleep(1);
+    if (haveFilesChanged(&project) && buildProject(&project, inputPath, outputPath, TRUE)) {
+      reclaimProject(&project);
+      if (report) {
+        MemoryReport memory = measureMemory(&project);
+        printMemoryReport(&memory);
+      }
+    }
+    fflush(stdout);
+  }
   return 0;
 }
 
@@ -270,6 +694,7 @@ int isAttributeAssigner(Token token) {
 
 int isOperator(Token token) {
   return (
+    token.type == TokenType_Global_Selector ||
     token.type == TokenType_Astrix ||
     token.type == TokenType_Slash
   );
@@ -358,6 +783,7 @@ LinkedListNode* createLinkedListNode() {
   LinkedListNode* node = (LinkedListNode*)malloc(sizeof(LinkedListNode));
   node -> data = NULL;
   node -> next = NULL;
+  logParseAllocation(node, PARSE_OWNED_BLOCK);
   return node;
 }
 
@@ -368,13 +794,73 @@ Array linkedListToArray(LinkedListNode* front, SyntaxNode* node, int size) {
   array.length = size;
   array.items = (void**)malloc(sizeof(void*) * size);
   while(current != NULL) {
+    LinkedListNode* next = current -> next;
     array.items[i] = current -> data;
-    current = current -> next;
+    logParseAllocation(current, PARSE_RELEASED);
+    free(current);
+    current = next;
     i++;
   }
   return array;
 }
 
+SyntaxNode* readStylesheet(TokenStream* stream) {
+  SyntaxNode* node = createNode(NodeType_Stylesheet);
+  LinkedListNode* front = NULL;
+  LinkedListNode* prev = NULL;
+  int listSize = 0;
+  runWhiteSpace(stream);
+  node -> left = readImports(stream);
+  while(currentToken(stream).type != TokenType_EOF) {
+    listSize++;
+    LinkedListNode* current = createLinkedListNode();
+    current -> data = readRuleset(stream);
+    if (front == NULL) {
+      front = current;
+      prev = front;
+    } else {
+      prev -> next = current;
+      prev = current;
+    }
+    runWhiteSpace(stream);
+  }
+  Array array = linkedListToArray(front, node, listSize);
+  node -> list = array;
+  return node;
+}
+
+// [Parser]readImports
+// Reads the @import "path" lines at the top of a stylesheet into one node
+// listing their path strings. The semi colon after each is optional.
+SyntaxNode* readImports(TokenStream* stream) {
+  SyntaxNode* node = createNode(NodeType_Import);
+  LinkedListNode* front = NULL;
+  LinkedListNode* prev = NULL;
+  int listSize = 0;
+  while(currentToken(stream).type == TokenType_Import) {
+    listSize++;
+    LinkedListNode* current = createLinkedListNode();
+    advance(stream);
+    runWhiteSpace(stream);
+    current -> data = readString(stream);
+    runWhiteSpace(stream);
+    if (currentToken(stream).type == TokenType_Semi_Colon) {
+      advance(stream);
+      runWhiteSpace(stream);
+    }
+    if (front == NULL) {
+      front = current;
+      prev = front;
+    } else {
+      prev -> next = current;
+      prev = current;
+    }
+  }
+  Array array = linkedListToArray(front, node, listSize);
+  node -> list = array;
+  return internNode(node);
+}
+
 SyntaxNode* readRuleset(TokenStream* stream) {
   SyntaxNode* node = createNode(NodeType_Ruleset);
   SyntaxNode* selectorNode = readAllSelectorsInRuleSet(stream);
@@ -395,7 +881,14 @@ SyntaxNode* readAllSelectorsInRuleSet(TokenStream* stream) {
     LinkedListNode* current = createLinkedListNode();
     runWhiteSpace(stream);
     Selector* selector = readSelector(stream);
+    if (selector -> simpleSelector == NULL) {
+      parseError("[error] expected selector actual:%d offset:%d \n", currentToken(stream).type, stream -> offset);
+    }
     current -> data = selector;
+    runWhiteSpace(stream);
+    if (currentToken(stream).type == TokenType_Comma) {
+      advance(stream);
+    }
     if (front == NULL) {
       front = current;
       prev = front;
@@ -406,7 +899,7 @@ SyntaxNode* readAllSelectorsInRuleSet(TokenStream* stream) {
   }
   Array array = linkedListToArray(front, node, listSize);
   node -> list = array;
-  return node;
+  return internNode(node);
 }
 
 SyntaxNode* readAllDeclarationsInRuleSet(TokenStream* stream) {
@@ -433,25 +926,37 @@ SyntaxNode* readAllDeclarationsInRuleSet(TokenStream* stream) {
       prev = current;
     }
   }
+  nextToken(stream, TokenType_Right_Curly);
   Array array = linkedListToArray(front, node, listSize);
   node -> list = array;
-  return node;
+  return internNode(node);
 }
 
 Declaration* readDeclaration(TokenStream* stream) {
   Declaration* declaration = (Declaration*)malloc(sizeof(Declaration));
+  logParseAllocation(declaration, PARSE_OWNED_BLOCK);
   declaration -> property = readIdentifier(stream);
   runWhiteSpace(stream);
   nextToken(stream, TokenType_Colon);
   runWhiteSpace(stream);
-  declaration -> expression = readIdentifier(stream);
+  declaration -> expression = readExpression(stream);
   runWhiteSpace(stream);
-  return declaration;
+  declaration -> important = FALSE;
+  if (currentToken(stream).type == TokenType_Important) {
+    advance(stream);
+    declaration -> important = TRUE;
+    runWhiteSpace(stream);
+  }
+  return internDeclaration(declaration);
 }
 
 Selector* readSelector(TokenStream* stream) {
   Selector* selector = (Selector*)malloc(sizeof(Selector));
+  logParseAllocation(selector, PARSE_OWNED_BLOCK);
+  selector -> combinator = NULL;
+  selector -> selector = NULL;
   selector -> simpleSelector = readSimpleSelector(stream);
+  selector -> specificity = readSpecificity(selector -> simpleSelector);
   runWhiteSpace(stream);
   if (currentToken(stream).type == TokenType_Plus || currentToken(stream).type == TokenType_Greater_Than) {
     selector -> combinator = readCombinator(stream);
@@ -459,29 +964,32 @@ Selector* readSelector(TokenStream* stream) {
     if (isCSSSelector(currentToken(stream)) || isElementName(currentToken(stream))) {
       selector -> selector = readSelector(stream);
     } else {
-      exit(1);
+      parseError("[error] expected selector after combinator actual:%d offset:%d \n", currentToken(stream).type, stream -> offset);
     }
   } else if (isCSSSelector(currentToken(stream)) || isElementName(currentToken(stream))) {
     selector -> selector = readSelector(stream);
   }
-  return selector;
+  if (selector -> selector != NULL) {
+    selector -> specificity = combineSpecificity(selector -> specificity, selector -> selector -> specificity);
+  }
+  return internSelector(selector);
 }
 
 SyntaxNode* readSimpleSelector(TokenStream* stream) {
   SyntaxNode* node = NULL;
   runWhiteSpace(stream);
-  if (isElementName(currentToken(stream))) {
+  if (currentToken(stream).type == TokenType_Global_Selector) {
+    advance(stream);
+    node = createNode(NodeType_Identifier);
+    node -> token = createToken("*", 1, TokenType_Identifier);
+    node = internNode(node);
+  } else if (isElementName(currentToken(stream))) {
     node = readIdentifier(stream);
   }
-  runWhiteSpace(stream);
   while (isCSSSelector(currentToken(stream))) {
     SyntaxNode* parent = readCSSSelector(stream);
     parent -> left = node;
-    node = parent;
-    int wasWhiteSpace = runWhiteSpace(stream);
-    if (wasWhiteSpace && currentToken(stream).type == TokenType_Colon) {
-      break;
-    }
+    node = internNode(parent);
   }
   return node;
 }
@@ -510,32 +1018,60 @@ SyntaxNode* readSelectorType(TokenStream* stream) {
 
 
 //TODO
-//1. readExpression
-//2. read semi colons in readAllDeclarationsInRuleSet
-//3. readFunction
-//4. readHexColor
+//1. read semi colons in readAllDeclarationsInRuleSet
+//2. readFunction
+//3. readHexColor
 
 SyntaxNode* readExpression(TokenStream* stream) {
+  SyntaxNode* left = readProduct(stream);
+  while(isUnaryOperator(currentToken(stream))) {
+    Token operator = currentToken(stream);
+    advance(stream);
+    runWhiteSpace(stream);
+
+    SyntaxNode* node = createNode(NodeType_Expression);
+    SyntaxNode* right = readProduct(stream);
+    node -> right = right;
+    node -> left = left;
+    node -> token = operator;
+    left = internNode(node);
+  }
+  return left;
+}
+
+SyntaxNode* readProduct(TokenStream* stream) {
   SyntaxNode* left = readTerm(stream);
   while(isOperator(currentToken(stream))) {
     Token operator = currentToken(stream);
     advance(stream);
+    runWhiteSpace(stream);
 
     SyntaxNode* node = createNode(NodeType_Expression);
     SyntaxNode* right = readTerm(stream);
     node -> right = right;
     node -> left = left;
     node -> token = operator;
-    left = node;
+    left = internNode(node);
   }
   return left;
 }
 
 SyntaxNode* readTerm(TokenStream* stream) {
-  SyntaxNode* node = createNode(NodeType_Term);
   Token token = currentToken(stream);
+  if (!isTerm(token)) {
+    parseError("[error] expected term actual:%d offset:%d \n", token.type, stream -> offset);
+  }
+  advance(stream);
+  SyntaxNode* node = createNode(NodeType_Term);
   node -> token = token;
-  return node;
+  if (token.type == TokenType_Number && isUnitOperator(currentToken(stream))) {
+    SyntaxNode* unit = createNode(NodeType_Term);
+    unit -> token = currentToken(stream);
+    advance(stream);
+    node -> left = internNode(unit);
+  }
+  runWhiteSpace(stream);
+  return internNode(node);
 }
 
 SyntaxNode* readFunction(TokenStream* stream) {
@@ -547,7 +1083,7 @@ SyntaxNode* readCombinator(TokenStream* stream) {
   Token token = currentToken(stream);
   advance(stream);
   node -> token = token;
-  return node;
+  return internNode(node);
 }
 
 SyntaxNode* readClass(TokenStream* stream) {
@@ -555,7 +1091,7 @@ SyntaxNode* readClass(TokenStream* stream) {
   Token token = nextToken(stream, TokenType_Identifier);
   SyntaxNode* node = createNode(NodeType_Class);
   node->token = token;
-  return node;
+  return internNode(node);
 }
 
 SyntaxNode* readId(TokenStream* stream) {
@@ -563,7 +1099,7 @@ SyntaxNode* readId(TokenStream* stream) {
   Token token = nextToken(stream, TokenType_Identifier);
   SyntaxNode* node = createNode(NodeType_Id);
   node->token = token;
-  return node;
+  return internNode(node);
 }
 
 SyntaxNode* readPsuedo(TokenStream* stream) {
@@ -571,35 +1107,39 @@ SyntaxNode* readPsuedo(TokenStream* stream) {
   Token token = nextToken(stream, TokenType_Identifier);
   SyntaxNode* node = createNode(NodeType_Psuedo);
   node->token = token;
-  return node;
+  return internNode(node);
 }
 
 SyntaxNode* readAttribute(TokenStream* stream) {
   nextToken(stream, TokenType_Left_Bracket);
   runWhiteSpace(stream);
-  SyntaxNode* node = readAttributeAssignment(stream);
-  if (node != NULL) {
+  SyntaxNode* node = createNode(NodeType_Data_Attribute);
+  node -> token = nextToken(stream, TokenType_Identifier);
+  runWhiteSpace(stream);
+  if (currentToken(stream).type != TokenType_Right_Bracket) {
+    SyntaxNode* assigner = readAttributeAssignment(stream);
+    if (assigner == NULL) {
+      parseError("[error] expected attribute assigner offset:%d \n", stream -> offset);
+    }
     runWhiteSpace(stream);
-    if (currentToken(stream).type == TokenType_Identifier) {
-      nextToken(stream, TokenType_Identifier);
-      node -> left = readIdentifier(stream);
-    } else if (currentToken(stream).type == TokenType_String) {
-      nextToken(stream, TokenType_String);
-      node -> left =  readString(stream);
+    if (currentToken(stream).type == TokenType_String) {
+      assigner -> left = readString(stream);
+    } else {
+      assigner -> left = readIdentifier(stream);
     }
+    node -> right = internNode(assigner);
+    runWhiteSpace(stream);
   }
   nextToken(stream, TokenType_Right_Bracket);
-  runWhiteSpace(stream);
-  return node;
+  return internNode(node);
 }
 
 SyntaxNode* readAttributeAssignment(TokenStream* stream) {
-  SyntaxNode* node = (SyntaxNode*)malloc(sizeof(SyntaxNode));
   runWhiteSpace(stream);
   Token token = currentToken(stream);
   advance(stream);
-  node -> type = NodeType_Attribute_Assigner;
   if (isAttributeAssigner(token)) {
+    SyntaxNode* node = createNode(NodeType_Attribute_Assigner);
     node -> token = token;
     return node;
   }
@@ -610,120 +1150,1948 @@ SyntaxNode* readString(TokenStream* stream) {
   Token token = nextToken(stream, TokenType_String);
   SyntaxNode* node = createNode(NodeType_String);
   node -> token = token;
-  return node;
+  return internNode(node);
 }
 
 SyntaxNode* readIdentifier(TokenStream* stream) {
   Token token = nextToken(stream, TokenType_Identifier);
   SyntaxNode* node = createNode(NodeType_Identifier);
   node -> token = token;
-  return node;
+  return internNode(node);
 }
 
 SyntaxNode* createNode(NodeType type) {
   SyntaxNode* node = (SyntaxNode*)malloc(sizeof(SyntaxNode));
   node -> type = type;
+  node -> token.type = TokenType_Unknown;
+  node -> token.chars = NULL;
+  node -> list.items = NULL;
+  node -> list.length = 0;
+  node -> left = NULL;
+  node -> right = NULL;
+  logParseAllocation(node, PARSE_OWNED_NODE);
   return node;
 }
 
-TokenStream* readFile(FILE* file) {
-  TokenStream* stream = (TokenStream*)malloc(sizeof(TokenStream));
-  int size;
-  int ch;
-  fseek(file, 0, SEEK_END);
-  size = ftell(file);
-  fseek(file, 0, SEEK_SET);
-  char* chars = (char*)malloc(sizeof(char) * size);
-  for (int i = 0; i < size; i++) {
-    ch = fgetc(file);
-    chars[i] = (char)ch;
+// [Plan]planDeclarations
+// Orders the declarations of one ruleset for evaluation. A declaration
+// depends on another when its expression names that declaration's property.
+// The strongly connected components of that graph, found with Tarjan's
+// algorithm, come out dependencies first. Components of one declaration that
+// does not read itself are plain assignments the runtime can evaluate in
+// order; the rest are cycles and are left to the solver.
+EvaluationPlan planDeclarations(SyntaxNode* declarations) {
+  int count = declarations -> list.length;
+  Declaration** items = (Declaration**)declarations -> list.items;
+  PointerMap properties = {NULL, NULL, 0, 0};
+  PlanState state;
+  EvaluationPlan plan;
+  for (int i = 0; i < count; i++) {
+    putPointerMap(&properties, items[i] -> property -> token.chars, i);
   }
-  stream -> chars = chars;
-  stream -> offset = 0;
-  stream -> length = size;
-  advance(stream);
-  return stream;
-}
-
-Token nextToken(TokenStream* stream, TokenType type) {
-  Token token = currentToken(stream);
-  if (token.type != type) {
-    printf("[error] expected:%d actual:%d offset:%d \n", type, token.type, stream -> offset);
-    exit(0);
+  state.edgeStart = (int*)malloc(sizeof(int) * (count + 1));
+  state.edgeStart[0] = 0;
+  for (int i = 0; i < count; i++) {
+    state.edgeStart[i + 1] = state.edgeStart[i] + collectReferences(items[i] -> expression, &properties, NULL, 0);
   }
-  advance(stream);
-  return token;
+  state.edges = (int*)malloc(sizeof(int) * (state.edgeStart[count] + 1));
+  for (int i = 0; i < count; i++) {
+    collectReferences(items[i] -> expression, &properties, state.edges, state.edgeStart[i]);
+  }
+  state.index = (int*)malloc(sizeof(int) * count);
+  state.lowLink = (int*)malloc(sizeof(int) * count);
+  state.onStack = (int*)malloc(sizeof(int) * count);
+  state.stack = (int*)malloc(sizeof(int) * count);
+  state.stackLength = 0;
+  state.nextIndex = 0;
+  state.plan = &plan;
+  plan.order = (int*)malloc(sizeof(int) * count);
+  plan.groupStart = (int*)malloc(sizeof(int) * (count + 1));
+  plan.cyclic = (int*)malloc(sizeof(int) * count);
+  plan.groups = 0;
+  plan.groupStart[0] = 0;
+  for (int i = 0; i < count; i++) {
+    state.index[i] = -1;
+    state.onStack[i] = FALSE;
+  }
+  for (int i = 0; i < count; i++) {
+    if (state.index[i] == -1) {
+      connectDeclaration(&state, i);
+    }
+  }
+  freePointerMap(&properties);
+  free(state.edgeStart);
+  free(state.edges);
+  free(state.index);
+  free(state.lowLink);
+  free(state.onStack);
+  free(state.stack);
+  return plan;
 }
 
-//[Tokens] readToken
-Token readToken(TokenStream* stream) {
-  if (stream -> offset == stream -> length) {
-    return token_eof;
+// [Plan]collectReferences
+// Finds the identifier terms in an expression that name a property of the
+// same ruleset. Writes their declaration indices from offset when references
+// is not NULL, and returns how many there are.
+int collectReferences(SyntaxNode* expression, PointerMap* properties, int* references, int offset) {
+  if (expression == NULL) {
+    return 0;
   }
-
-  char ch = stream->chars[stream->offset];
-  if (isspace(ch)) {
-    return readWhiteSpaceToken(stream);
+  if (expression -> type == NodeType_Expression) {
+    int count = collectReferences(expression -> left, properties, references, offset);
+    return count + collectReferences(expression -> right, properties, references, offset + count);
   }
-  if (ch == '\"' || ch == '\'') {
-    return readStringToken(stream, ch);
+  if (expression -> token.type != TokenType_Identifier) {
+    return 0;
   }
-  if (isalpha(ch)) {
-    return readIndentifierToken(stream);
+  int index = getPointerMap(properties, expression -> token.chars, -1);
+  if (index == -1) {
+    return 0;
   }
-  if (isdigit(ch)) {
-    return readNumberToken(stream);
+  if (references != NULL) {
+    references[offset] = index;
   }
-  for (int i = 0; i < sizeof(tokens) / sizeof(Token); i++) {
-    if (strncmp(tokens[i].chars, &stream -> chars[stream -> offset], strlen(tokens[i].chars)) == 0) {
-      stream -> offset += strlen(tokens[i].chars);
-      return tokens[i];
+  return 1;
+}
+
+void connectDeclaration(PlanState* state, int declaration) {
+  state -> index[declaration] = state -> nextIndex;
+  state -> lowLink[declaration] = state -> nextIndex;
+  state -> nextIndex++;
+  state -> stack[state -> stackLength++] = declaration;
+  state -> onStack[declaration] = TRUE;
+  int readsItself = FALSE;
+  for (int i = state -> edgeStart[declaration]; i < state -> edgeStart[declaration + 1]; i++) {
+    int dependency = state -> edges[i];
+    if (dependency == declaration) {
+      readsItself = TRUE;
+    }
+    if (state -> index[dependency] == -1) {
+      connectDeclaration(state, dependency);
+      if (state -> lowLink[dependency] < state -> lowLink[declaration]) {
+        state -> lowLink[declaration] = state -> lowLink[dependency];
+      }
+    } else if (state -> onStack[dependency] && state -> index[dependency] < state -> lowLink[declaration]) {
+      state -> lowLink[declaration] = state -> index[dependency];
     }
   }
-  Token token = createToken(&stream -> chars[stream -> offset], 1, TokenType_Unknown);
-  stream->offset ++;
-  return token;
+  if (state -> lowLink[declaration] != state -> index[declaration]) {
+    return;
+  }
+  EvaluationPlan* plan = state -> plan;
+  int start = plan -> groupStart[plan -> groups];
+  int end = start;
+  int member;
+  do {
+    member = state -> stack[--state -> stackLength];
+    state -> onStack[member] = FALSE;
+    plan -> order[end++] = member;
+  } while (member != declaration);
+  plan -> cyclic[plan -> groups] = readsItself || end - start > 1;
+  plan -> groups++;
+  plan -> groupStart[plan -> groups] = end;
 }
 
-Token readWhiteSpaceToken(TokenStream* stream) {
-  Token token = createToken(&stream -> chars[stream -> offset], 1, TokenType_WhiteSpace);
-  stream -> offset ++;
-  return token;
+void freeEvaluationPlan(EvaluationPlan* plan) {
+  free(plan -> order);
+  free(plan -> groupStart);
+  free(plan -> cyclic);
 }
 
-Token readIndentifierToken(TokenStream* stream) {
-  int offset = stream->offset;
-  while (isalnum(stream->chars[offset]) || stream->chars[offset] == '-') {
-    offset++;
+// [Plan]writePlan
+// Writes a plan as a list of steps, {assign: i} for a declaration the runtime
+// can evaluate directly and {solve: [i, ...]} for a cycle it has to hand to
+// the solver, where each index points into the rule's declarations.
+void writePlan(Buffer* buffer, EvaluationPlan* plan) {
+  char number[16];
+  appendString(buffer, "[");
+  for (int i = 0; i < plan -> groups; i++) {
+    appendString(buffer, i > 0 ? ", " : "");
+    appendString(buffer, plan -> cyclic[i] ? "{solve: [" : "{assign: ");
+    for (int j = plan -> groupStart[i]; j < plan -> groupStart[i + 1]; j++) {
+      snprintf(number, sizeof(number), j > plan -> groupStart[i] ? ", %d" : "%d", plan -> order[j]);
+      appendString(buffer, number);
+    }
+    appendString(buffer, plan -> cyclic[i] ? "]}" : "}");
   }
-  Token token = createToken(&stream->chars[stream->offset], offset - stream -> offset, TokenType_Identifier);
-  stream -> offset = offset;
-  return token;
+  appendString(buffer, "]");
 }
 
-Token readNumberToken(TokenStream* stream) {
-  int offset = stream->offset;
-  while(isdigit(stream->chars[offset])) {
-    offset++;
+// [Build]buildStylesheet
+// Optimizes a parsed stylesheet and derives everything emitted for it: the
+// cascade index, the stable rule ids used to diff it against later builds
+// and the evaluation plan of each rule.
+Build buildStylesheet(SyntaxNode* stylesheet, int version) {
+  Build build;
+  build.stylesheet = stylesheet;
+  optimizeStylesheet(build.stylesheet);
+  build.cascade = buildCascadeIndex(build.stylesheet);
+  build.ruleIds = assignRuleIds(build.stylesheet);
+  assignCascadeRanks(&build);
+  build.plans = (EvaluationPlan*)malloc(sizeof(EvaluationPlan) * build.stylesheet -> list.length);
+  for (int i = 0; i < build.stylesheet -> list.length; i++) {
+    SyntaxNode* ruleset = (SyntaxNode*)build.stylesheet -> list.items[i];
+    build.plans[i] = planDeclarations(ruleset -> right);
   }
-  Token token = createToken(&stream->chars[stream->offset], offset - stream -> offset, TokenType_Number);
-  stream -> offset = offset;
-  return token;
+  build.version = version;
+  return build;
 }
 
-Token readStringToken(TokenStream* stream, char quoteType) {
-  int offset = stream->offset + 1;
-  while(stream->chars[offset] != quoteType) {
-    offset++;
+// [Project]buildProject
+// Brings the outputs of the root file and everything it imports up to date.
+// Every file is hashed, but only files whose hash differs from the last build
+// are parsed again. A file is re-emitted when it or anything it imports
+// changed, or when its output is missing; the rest are left alone. When
+// incremental is TRUE a file that was built earlier in this process gets a
+// patch appended instead of a full rewrite. The graph and hashes are saved
+// next to the root output so the next run can skip clean files too.
+// Returns FALSE when a file is missing, fails to parse or the imports form a
+// cycle. Outputs that were already written stay, and the files involved are
+// parsed again on the next build.
+int buildProject(Project* project, char const* inputPath, char const* outputPath, int incremental) {
+  char* graphPath = (char*)malloc(sizeof(char) * (strlen(outputPath) + 6));
+  sprintf(graphPath, "%s.deps", outputPath);
+  if (project -> length == 0) {
+    loadDependencyGraph(project, graphPath);
   }
-  offset++;
-  Token token = createToken(&stream->chars[stream->offset], offset - stream -> offset, TokenType_String);
-  stream -> offset = offset;
-  return token;
-}
+  for (int i = 0; i < project -> length; i++) {
+    project -> files[i].visited = FALSE;
+    project -> files[i].state = 0;
+    project -> files[i].refreshed = FALSE;
+  }
+  project -> failed = FALSE;
+  clearMissingPaths(project);
 
-Token currentToken(TokenStream* stream) {
-  return stream -> currentToken;
+  int root = loadSourceFile(project, inputPath);
+  int* stack = (int*)malloc(sizeof(int) * (project -> length + 1));
+  if (root == -1 || findImportCycle(project, root, stack, 0)) {
+    project -> failed = TRUE;
+  }
+  free(stack);
+  if (project -> failed) {
+    forgetVisitedFiles(project);
+    free(graphPath);
+    return FALSE;
+  }
+  if (project -> files[root].outputPath != outputPath) {
+    free(project -> files[root].outputPath);
+    project -> files[root].outputPath = (char*)outputPath;
+  }
+
+  int rebuilt = 0;
+  refreshSourceFile(project, root, incremental, &rebuilt);
+  if (project -> failed) {
+    forgetVisitedFiles(project);
+    free(graphPath);
+    return FALSE;
+  }
+  saveDependencyGraph(project, graphPath);
+  free(graphPath);
+  int reachable = 0;
+  for (int i = 0; i < project -> length; i++) {
+    project -> files[i].watched = project -> files[i].visited;
+    reachable += project -> files[i].visited;
+  }
+  printf(">>> Rebuilt %d Of %d Files.\n", rebuilt, reachable);
+  return TRUE;
+}
+
+void forgetVisitedFiles(Project* project) {
+  for (int i = 0; i < project -> length; i++) {
+    if (project -> files[i].visited) {
+      project -> files[i].known = FALSE;
+    }
+  }
+}
+
+// [Project]addMissingPath
+// Remembers a path a failed build could not find, so watch mode polls it and
+// rebuilds once the file is back.
+void addMissingPath(Project* project, char const* path) {
+  if (project -> missingCount == project -> missingCapacity) {
+    project -> missingCapacity = project -> missingCapacity == 0 ? 4 : project -> missingCapacity * 2;
+    project -> missing = (char**)realloc(project -> missing, sizeof(char*) * project -> missingCapacity);
+  }
+  char* copy = (char*)malloc(sizeof(char) * (strlen(path) + 1));
+  strcpy(copy, path);
+  project -> missing[project -> missingCount] = copy;
+  project -> missingCount++;
+}
+
+void clearMissingPaths(Project* project) {
+  for (int i = 0; i < project -> missingCount; i++) {
+    free(project -> missing[i]);
+  }
+  project -> missingCount = 0;
+}
+
+int addSourceFile(Project* project, char* path) {
+  if (project -> length == project -> capacity) {
+    project -> capacity = project -> capacity == 0 ? 16 : project -> capacity * 2;
+    project -> files = (SourceFile*)realloc(project -> files, sizeof(SourceFile) * project -> capacity);
+  }
+  SourceFile* source = &project -> files[project -> length];
+  memset(source, 0, sizeof(SourceFile));
+  source -> path = path;
+  source -> outputPath = defaultOutputPath(path);
+  putPointerMap(&project -> paths, path, project -> length);
+  return project -> length++;
+}
+
+// [Project]findSourceFile
+// Returns the index of a file in the project by its canonical path, adding it
+// when it is not there yet.
+int findSourceFile(Project* project, char const* path) {
+  char* canonical = internString((char*)path, strlen(path));
+  int index = getPointerMap(&project -> paths, canonical, -1);
+  if (index == -1) {
+    index = addSourceFile(project, canonical);
+  }
+  return index;
+}
+
+// [Project]loadSourceFile
+// Hashes a file and, when it changed since the last build, parses it and
+// resolves its imports. Then does the same for everything it imports. Returns
+// the file's index, or -1 when it or one of its imports does not exist.
+int loadSourceFile(Project* project, char const* path) {
+  char* resolved = realpath(path, NULL);
+  if (resolved == NULL) {
+    printf("Imported File \"%s\" Does Not Exist.\n", path);
+    addMissingPath(project, path);
+    return -1;
+  }
+  int index = findSourceFile(project, resolved);
+  free(resolved);
+  if (project -> files[index].visited) {
+    return index;
+  }
+  project -> files[index].visited = TRUE;
+
+  SourceFile* source = &project -> files[index];
+  FILE* file = fopen(source -> path, "r");
+  if (!file) {
+    printf("Imported File \"%s\" Does Not Exist.\n", source -> path);
+    addMissingPath(project, source -> path);
+    return -1;
+  }
+  struct stat info;
+  if (stat(source -> path, &info) == 0) {
+    source -> modifiedTime = readModifiedTime(&info);
+    source -> modifiedSize = info.st_size;
+  }
+  TokenStream* tokenStream = readFile(file);
+  fclose(file);
+  unsigned long long hash = hashBytes64(HASH_SEED_64, tokenStream -> chars, tokenStream -> length);
+  source -> changed = !source -> known || hash != source -> hash;
+  if (source -> changed) {
+    SyntaxNode* stylesheet = parseSourceFile(tokenStream, source -> path);
+    if (stylesheet == NULL) {
+      freeTokenStream(tokenStream);
+      return -1;
+    }
+    source -> hash = hash;
+    if (source -> stylesheet != NULL) {
+      freeStylesheet(source -> stylesheet);
+    }
+    source -> stylesheet = stylesheet;
+  }
+  freeTokenStream(tokenStream);
+  source -> known = TRUE;
+  if (source -> changed && !resolveImports(project, index)) {
+    return -1;
+  }
+
+  for (int i = 0; i < project -> files[index].importCount; i++) {
+    int import = project -> files[index].imports[i];
+    if (loadSourceFile(project, project -> files[import].path) == -1) {
+      return -1;
+    }
+  }
+  return index;
+}
+
+// [Project]resolveImports
+// Turns the @import paths of a freshly parsed file into project indices.
+// Paths are relative to the importing file.
+int resolveImports(Project* project, int index) {
+  SyntaxNode* imports = project -> files[index].stylesheet -> left;
+  char* directory = project -> files[index].path;
+  int directoryLength = strrchr(directory, '/') - directory + 1;
+  int* indices = (int*)malloc(sizeof(int) * (imports -> list.length + 1));
+  for (int i = 0; i < imports -> list.length; i++) {
+    char* quoted = ((SyntaxNode*)imports -> list.items[i]) -> token.chars;
+    int length = strlen(quoted) - 2;
+    char* path = (char*)malloc(sizeof(char) * (directoryLength + length + 1));
+    if (quoted[1] == '/') {
+      memcpy(path, &quoted[1], length);
+      path[length] = '\0';
+    } else {
+      memcpy(path, directory, directoryLength);
+      memcpy(&path[directoryLength], &quoted[1], length);
+      path[directoryLength + length] = '\0';
+    }
+    char* resolved = realpath(path, NULL);
+    if (resolved == NULL) {
+      printf("Imported File \"%s\" Does Not Exist.\n", path);
+      addMissingPath(project, path);
+      free(path);
+      free(indices);
+      return FALSE;
+    }
+    indices[i] = findSourceFile(project, resolved);
+    free(resolved);
+    free(path);
+    directory = project -> files[index].path;
+  }
+  free(project -> files[index].imports);
+  project -> files[index].imports = indices;
+  project -> files[index].importCount = imports -> list.length;
+  return TRUE;
+}
+
+// [Project]findImportCycle
+// Depth first walk over the import graph. Prints the chain and returns TRUE
+// when a file imports itself, directly or through other files.
+int findImportCycle(Project* project, int index, int* stack, int depth) {
+  SourceFile* source = &project -> files[index];
+  if (source -> state == 2) {
+    return FALSE;
+  }
+  if (source -> state == 1) {
+    int start = depth - 1;
+    while (stack[start] != index) {
+      start--;
+    }
+    printf("[error] import cycle:");
+    for (int i = start; i < depth; i++) {
+      printf(" %s ->", project -> files[stack[i]].path);
+    }
+    printf(" %s\n", source -> path);
+    return TRUE;
+  }
+  source -> state = 1;
+  stack[depth] = index;
+  for (int i = 0; i < source -> importCount; i++) {
+    if (findImportCycle(project, source -> imports[i], stack, depth + 1)) {
+      return TRUE;
+    }
+  }
+  project -> files[index].state = 2;
+  return FALSE;
+}
+
+// [Project]refreshSourceFile
+// Re-emits a file after its imports when it is stale. Returns whether it was.
+int refreshSourceFile(Project* project, int index, int incremental, int* rebuilt) {
+  if (project -> files[index].refreshed) {
+    return project -> files[index].stale;
+  }
+  struct stat info;
+  int stale = project -> files[index].changed || stat(project -> files[index].outputPath, &info) != 0;
+  for (int i = 0; i < project -> files[index].importCount; i++) {
+    if (refreshSourceFile(project, project -> files[index].imports[i], incremental, rebuilt)) {
+      stale = TRUE;
+    }
+  }
+  SourceFile* source = &project -> files[index];
+  source -> refreshed = TRUE;
+  source -> stale = stale;
+  if (!stale || project -> failed) {
+    return stale;
+  }
+
+  int* included = (int*)calloc(project -> length, sizeof(int));
+  SyntaxNode* stylesheet = createNode(NodeType_Stylesheet);
+  int size = flattenSourceFile(project, index, included, NULL, 0);
+  if (size == -1) {
+    project -> failed = TRUE;
+    free(included);
+    freeStylesheet(stylesheet);
+    return TRUE;
+  }
+  memset(included, 0, sizeof(int) * project -> length);
+  stylesheet -> list.items = (void**)malloc(sizeof(void*) * (size + 1));
+  stylesheet -> list.length = flattenSourceFile(project, index, included, stylesheet -> list.items, 0);
+  free(included);
+
+  source = &project -> files[index];
+  if (incremental && source -> hasBuild) {
+    Build next = buildStylesheet(stylesheet, source -> build.version + 1);
+    char number[16];
+    snprintf(number, sizeof(number), "%d", next.version);
+    char* patchPath = patchOutputPath(source -> outputPath, number);
+    if (emitPatch(patchPath, &source -> build, &next) > 0) {
+      emitStylesheet(source -> outputPath, &next);
+      removePatchFile(source -> outputPath, next.version - PATCH_HISTORY);
+    } else {
+      next.version = source -> build.version;
+    }
+    free(patchPath);
+    freeBuild(&source -> build);
+    source -> build = next;
+  } else {
+    if (source -> hasBuild) {
+      freeBuild(&source -> build);
+    }
+    source -> build = buildStylesheet(stylesheet, 0);
+    removePatchFiles(source -> outputPath);
+    emitStylesheet(source -> outputPath, &source -> build);
+  }
+  source -> hasBuild = TRUE;
+  (*rebuilt)++;
+  return TRUE;
+}
+
+// [Project]parseSourceFile
+// Parses one file of the project. A syntax error is printed and NULL returned
+// instead of exiting, so a watcher that catches a half typed save keeps its
+// previous build and goes on polling.
+SyntaxNode* parseSourceFile(TokenStream* tokenStream, char const* path) {
+  jmp_buf recovery;
+  if (setjmp(recovery) != 0) {
+    parseRecovery = NULL;
+    freeParseAllocations();
+    printf(">>> Could Not Parse \"%s\".\n", path);
+    return NULL;
+  }
+  parseRecovery = &recovery;
+  SyntaxNode* stylesheet = readStylesheet(tokenStream);
+  parseRecovery = NULL;
+  resetParseLog();
+  return stylesheet;
+}
+
+// [Parser]logParseAllocation
+// While a project file is being parsed, records each allocation the parser
+// makes and each one that is handed to an intern table or freed by it, so a
+// failed parse can give back what it still owned. Appending keeps the cost
+// off the common path; the log is only replayed when a parse fails.
+void logParseAllocation(void* pointer, int kind) {
+  if (parseRecovery == NULL) {
+    return;
+  }
+  if (parseLog.length == parseLog.capacity) {
+    parseLog.capacity = parseLog.capacity == 0 ? 1024 : parseLog.capacity * 2;
+    parseLog.pointers = (void**)realloc(parseLog.pointers, sizeof(void*) * parseLog.capacity);
+    parseLog.kinds = (int*)realloc(parseLog.kinds, sizeof(int) * parseLog.capacity);
+  }
+  parseLog.pointers[parseLog.length] = pointer;
+  parseLog.kinds[parseLog.length] = kind;
+  parseLog.length++;
+}
+
+// [Parser]freeParseAllocations
+// Replays the log of an abandoned parse in order, so an address that was
+// freed and handed out again ends in its latest state, and frees every
+// allocation that is still owned: rulesets, list cells, the stylesheet and
+// nodes, selectors and declarations that never reached an intern table.
+void freeParseAllocations() {
+  PointerMap owned = {NULL, NULL, 0, 0};
+  for (int i = 0; i < parseLog.length; i++) {
+    putPointerMap(&owned, parseLog.pointers[i], parseLog.kinds[i]);
+  }
+  for (int i = 0; i < owned.capacity; i++) {
+    if (owned.keys[i] == NULL) {
+      continue;
+    }
+    if (owned.values[i] == PARSE_OWNED_NODE) {
+      releaseNode(owned.keys[i]);
+    } else if (owned.values[i] == PARSE_OWNED_BLOCK) {
+      free(owned.keys[i]);
+    }
+  }
+  freePointerMap(&owned);
+  resetParseLog();
+}
+
+// [Parser]resetParseLog
+// The log grows with the size of the file, so it is released after every
+// parse rather than kept at its high-water mark between builds.
+void resetParseLog() {
+  free(parseLog.pointers);
+  free(parseLog.kinds);
+  parseLog.pointers = NULL;
+  parseLog.kinds = NULL;
+  parseLog.length = 0;
+  parseLog.capacity = 0;
+}
+
+// [Parser]parseError
+// Prints a syntax error. Returns to parseSourceFile when a project file is
+// being parsed, otherwise exits with a failure status.
+void parseError(const char* format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  vprintf(format, arguments);
+  va_end(arguments);
+  if (parseRecovery != NULL) {
+    longjmp(*parseRecovery, 1);
+  }
+  exit(1);
+}
+
+// [Project]flattenSourceFile
+// Lists the rulesets a file compiles to: those of its imports, depth first
+// and each file once, followed by its own. Rulesets are copied because the
+// optimizer rewrites them in place, while the selector and declaration
+// subtrees they point to are shared. Files that were not parsed in this run
+// are parsed here. Counts without writing when rulesets is NULL. Returns -1
+// when a file fails to parse.
+int flattenSourceFile(Project* project, int index, int* included, void** rulesets, int length) {
+  if (included[index]) {
+    return length;
+  }
+  included[index] = TRUE;
+  for (int i = 0; i < project -> files[index].importCount; i++) {
+    length = flattenSourceFile(project, project -> files[index].imports[i], included, rulesets, length);
+    if (length == -1) {
+      return -1;
+    }
+  }
+  SourceFile* source = &project -> files[index];
+  if (source -> stylesheet == NULL) {
+    FILE* file = fopen(source -> path, "r");
+    TokenStream* tokenStream = readFile(file);
+    fclose(file);
+    source -> stylesheet = parseSourceFile(tokenStream, source -> path);
+    freeTokenStream(tokenStream);
+    if (source -> stylesheet == NULL) {
+      return -1;
+    }
+  }
+  for (int i = 0; i < source -> stylesheet -> list.length; i++) {
+    if (rulesets != NULL) {
+      SyntaxNode* ruleset = (SyntaxNode*)source -> stylesheet -> list.items[i];
+      SyntaxNode* copy = createNode(NodeType_Ruleset);
+      copy -> left = ruleset -> left;
+      copy -> right = ruleset -> right;
+      rulesets[length] = copy;
+    }
+    length++;
+  }
+  return length;
+}
+
+// [Project]loadDependencyGraph
+// Reads the graph saved by the last run. Each file is a line with its 64 bit
+// content hash in 16 hex digits and its path, followed by one indented line
+// per import. Files in any other format are skipped, so they are parsed again.
+void loadDependencyGraph(Project* project, char const* path) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    return;
+  }
+  char line[PATH_MAX + 24];
+  int current = -1;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    if (line[0] == ' ' && current != -1) {
+      int import = findSourceFile(project, &line[2]);
+      SourceFile* source = &project -> files[current];
+      source -> imports = (int*)realloc(source -> imports, sizeof(int) * (source -> importCount + 1));
+      source -> imports[source -> importCount++] = import;
+    } else if (line[0] != ' ') {
+      char* end;
+      unsigned long long hash = strtoull(line, &end, 16);
+      current = -1;
+      if (end - line == 16 && end[0] == ' ' && end[1] != '\0') {
+        current = findSourceFile(project, &end[1]);
+        project -> files[current].hash = hash;
+        project -> files[current].known = TRUE;
+      }
+    }
+  }
+  fclose(file);
+}
+
+void saveDependencyGraph(Project* project, char const* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    printf("Dependency Graph \"%s\" Could Not Be Written.\n", path);
+    return;
+  }
+  for (int i = 0; i < project -> length; i++) {
+    SourceFile* source = &project -> files[i];
+    if (!source -> visited) {
+      continue;
+    }
+    fprintf(file, "%016llx %s\n", source -> hash, source -> path);
+    for (int j = 0; j < source -> importCount; j++) {
+      fprintf(file, "  %s\n", project -> files[source -> imports[j]].path);
+    }
+  }
+  fclose(file);
+}
+
+// [Memory]freeStylesheet
+// Frees a stylesheet as it comes out of readStylesheet or flattenSourceFile.
+// Only the stylesheet node, its list and its rulesets belong to it; the
+// interned subtrees they point to are left for reclaimProject.
+void freeStylesheet(SyntaxNode* stylesheet) {
+  for (int i = 0; i < stylesheet -> list.length; i++) {
+    free(stylesheet -> list.items[i]);
+  }
+  free(stylesheet -> list.items);
+  free(stylesheet);
+}
+
+void freeBuild(Build* build) {
+  for (int i = 0; i < build -> stylesheet -> list.length; i++) {
+    freeEvaluationPlan(&build -> plans[i]);
+  }
+  free(build -> plans);
+  free(build -> ruleIds);
+  free(build -> rankStart);
+  free(build -> ranks);
+  free(build -> cascade.entries);
+  freeStylesheet(build -> stylesheet);
+}
+
+void freeTokenStream(TokenStream* stream) {
+  inputBytes -= stream -> length + 1;
+  free(stream -> chars);
+  free(stream);
+}
+
+// [Memory]markNode
+// Marks a subtree and the token text in it as live. The items of a selector
+// list are Selectors and those of a declaration block Declarations; every
+// other list holds nodes.
+void markNode(PointerMap* marks, SyntaxNode* node) {
+  if (node == NULL || getPointerMap(marks, node, FALSE)) {
+    return;
+  }
+  putPointerMap(marks, node, TRUE);
+  if (node -> token.chars != NULL) {
+    putPointerMap(marks, node -> token.chars, TRUE);
+  }
+  for (int i = 0; i < node -> list.length; i++) {
+    if (node -> type == NodeType_Selector) {
+      markSelector(marks, (Selector*)node -> list.items[i]);
+    } else if (node -> type == NodeType_Declaration) {
+      Declaration* declaration = (Declaration*)node -> list.items[i];
+      putPointerMap(marks, declaration, TRUE);
+      markNode(marks, declaration -> property);
+      markNode(marks, declaration -> expression);
+    } else {
+      markNode(marks, (SyntaxNode*)node -> list.items[i]);
+    }
+  }
+  markNode(marks, node -> left);
+  markNode(marks, node -> right);
+}
+
+void markSelector(PointerMap* marks, Selector* selector) {
+  for (; selector != NULL && !getPointerMap(marks, selector, FALSE); selector = selector -> selector) {
+    putPointerMap(marks, selector, TRUE);
+    markNode(marks, selector -> simpleSelector);
+    markNode(marks, selector -> combinator);
+  }
+}
+
+void releaseNode(void* item) {
+  free(((SyntaxNode*)item) -> list.items);
+  free(item);
+}
+
+// [Memory]sweepInternTable
+// Frees every item of an intern table that was not marked and rehashes the
+// rest into a table sized for them, so the table shrinks again after a large
+// stylesheet is edited down. Returns the number of items freed.
+int sweepInternTable(InternTable* table, PointerMap* marks, void (*release)(void* item)) {
+  InternTable swept = {NULL, NULL, 64, 0};
+  int freed = 0;
+  for (int i = 0; i < table -> capacity; i++) {
+    if (table -> items[i] != NULL && getPointerMap(marks, table -> items[i], FALSE)) {
+      swept.length++;
+    }
+  }
+  while ((swept.length + 1) * 2 > swept.capacity) {
+    swept.capacity *= 2;
+  }
+  swept.items = (void**)calloc(swept.capacity, sizeof(void*));
+  swept.hashes = (unsigned int*)calloc(swept.capacity, sizeof(unsigned int));
+  for (int i = 0; i < table -> capacity; i++) {
+    if (table -> items[i] == NULL) {
+      continue;
+    }
+    if (!getPointerMap(marks, table -> items[i], FALSE)) {
+      release(table -> items[i]);
+      freed++;
+      continue;
+    }
+    int index = table -> hashes[i] & (swept.capacity - 1);
+    while (swept.items[index] != NULL) {
+      index = (index + 1) & (swept.capacity - 1);
+    }
+    swept.items[index] = table -> items[i];
+    swept.hashes[index] = table -> hashes[i];
+  }
+  free(table -> items);
+  free(table -> hashes);
+  *table = swept;
+  return freed;
+}
+
+// [Memory]reclaimProject
+// Frees everything an earlier build left behind, so a watcher that rebuilds
+// for days stays at the size of its current stylesheets. Files that are no
+// longer imported drop their parsed stylesheet and build, and will be parsed
+// again if they come back. Then every node, selector, declaration and string
+// reachable from the remaining files, their builds and the project's paths
+// is marked, and the intern tables are swept of the rest. Must only run after
+// a build that succeeded, when every reachable file is visited. Returns the
+// number of interned items freed.
+int reclaimProject(Project* project) {
+  PointerMap marks = {NULL, NULL, 0, 0};
+  for (int i = 0; i < project -> length; i++) {
+    SourceFile* source = &project -> files[i];
+    putPointerMap(&marks, source -> path, TRUE);
+    if (!source -> visited) {
+      if (source -> stylesheet != NULL) {
+        freeStylesheet(source -> stylesheet);
+        source -> stylesheet = NULL;
+      }
+      if (source -> hasBuild) {
+        freeBuild(&source -> build);
+        source -> hasBuild = FALSE;
+      }
+      continue;
+    }
+    markNode(&marks, source -> stylesheet);
+    if (source -> hasBuild) {
+      markNode(&marks, source -> build.stylesheet);
+      for (int j = 0; j < source -> build.stylesheet -> list.length; j++) {
+        putPointerMap(&marks, source -> build.ruleIds[j], TRUE);
+      }
+    }
+  }
+  int freed = sweepInternTable(&nodeTable, &marks, releaseNode);
+  freed += sweepInternTable(&selectorTable, &marks, free);
+  freed += sweepInternTable(&declarationTable, &marks, free);
+  freed += sweepInternTable(&stringTable, &marks, free);
+  freePointerMap(&marks);
+  return freed;
+}
+
+// [Memory]countNode
+// Adds a node and its list to a report, once per node.
+void countNode(MemoryReport* report, PointerMap* counted, SyntaxNode* node) {
+  if (getPointerMap(counted, node, FALSE)) {
+    return;
+  }
+  putPointerMap(counted, node, TRUE);
+  report -> nodes[node -> type]++;
+  report -> nodeBytes[node -> type] += sizeof(SyntaxNode);
+  report -> listBytes += sizeof(void*) * node -> list.length;
+}
+
+// [Memory]measureMemory
+// Breaks down the bytes held by the project: nodes by type, interned
+// selectors, declarations and token text, node lists, the intern tables and
+// project bookkeeping, builds, and input buffers that are still being read.
+// Sizes are what was asked of malloc, not counting its own overhead.
+MemoryReport measureMemory(Project* project) {
+  MemoryReport report;
+  PointerMap counted = {NULL, NULL, 0, 0};
+  InternTable* tables[] = {&stringTable, &nodeTable, &declarationTable, &selectorTable};
+  memset(&report, 0, sizeof(MemoryReport));
+  for (int i = 0; i < nodeTable.capacity; i++) {
+    if (nodeTable.items[i] != NULL) {
+      countNode(&report, &counted, (SyntaxNode*)nodeTable.items[i]);
+    }
+  }
+  for (int i = 0; i < stringTable.capacity; i++) {
+    if (stringTable.items[i] != NULL) {
+      report.strings++;
+      report.stringBytes += strlen((char*)stringTable.items[i]) + 1;
+    }
+  }
+  report.declarations = declarationTable.length;
+  report.declarationBytes = sizeof(Declaration) * declarationTable.length;
+  report.selectors = selectorTable.length;
+  report.selectorBytes = sizeof(Selector) * selectorTable.length;
+  for (int i = 0; i < 4; i++) {
+    report.tableBytes += (sizeof(void*) + sizeof(unsigned int)) * tables[i] -> capacity;
+  }
+  report.tableBytes += sizeof(SourceFile) * project -> capacity;
+  report.tableBytes += (sizeof(void*) + sizeof(int)) * project -> paths.capacity;
+  for (int i = 0; i < project -> length; i++) {
+    SourceFile* source = &project -> files[i];
+    report.tableBytes += sizeof(int) * source -> importCount + strlen(source -> outputPath) + 1;
+    SyntaxNode* stylesheets[] = {source -> stylesheet, source -> hasBuild ? source -> build.stylesheet : NULL};
+    for (int j = 0; j < 2; j++) {
+      if (stylesheets[j] == NULL) {
+        continue;
+      }
+      countNode(&report, &counted, stylesheets[j]);
+      for (int k = 0; k < stylesheets[j] -> list.length; k++) {
+        countNode(&report, &counted, (SyntaxNode*)stylesheets[j] -> list.items[k]);
+      }
+    }
+    if (!source -> hasBuild) {
+      continue;
+    }
+    Build* build = &source -> build;
+    report.buildBytes += sizeof(CascadeEntry) * build -> cascade.length;
+    report.buildBytes += (sizeof(EvaluationPlan) + sizeof(char*) + sizeof(int)) * build -> stylesheet -> list.length;
+    report.buildBytes += sizeof(int) * (build -> rankStart[build -> stylesheet -> list.length] * 2 + 1);
+    for (int j = 0; j < build -> stylesheet -> list.length; j++) {
+      int count = ((SyntaxNode*)build -> stylesheet -> list.items[j]) -> right -> list.length;
+      report.buildBytes += sizeof(int) * (count * 3 + 1);
+    }
+  }
+  report.inputBytes = inputBytes;
+  report.inputPeakBytes = inputPeakBytes;
+  report.totalBytes = report.stringBytes + report.declarationBytes + report.selectorBytes;
+  report.totalBytes += report.listBytes + report.tableBytes + report.buildBytes + report.inputBytes;
+  for (int i = 0; i <= NodeType_Import; i++) {
+    report.totalBytes += report.nodeBytes[i];
+  }
+  freePointerMap(&counted);
+  return report;
+}
+
+void printMemoryReport(MemoryReport* report) {
+  printf(">>> Memory: %ld Bytes\n", report -> totalBytes);
+  for (int i = 0; i <= NodeType_Import; i++) {
+    if (report -> nodes[i] > 0) {
+      printf("  %-28s %10ld %12ld\n", nodeTypeToString(i), report -> nodes[i], report -> nodeBytes[i]);
+    }
+  }
+  printf("  %-28s %10ld %12ld\n", "selectors", report -> selectors, report -> selectorBytes);
+  printf("  %-28s %10ld %12ld\n", "declarations", report -> declarations, report -> declarationBytes);
+  printf("  %-28s %10ld %12ld\n", "token text", report -> strings, report -> stringBytes);
+  printf("  %-28s %10s %12ld\n", "lists", "", report -> listBytes);
+  printf("  %-28s %10s %12ld\n", "tables", "", report -> tableBytes);
+  printf("  %-28s %10s %12ld\n", "builds", "", report -> buildBytes);
+  printf("  %-28s %10s %12ld (peak %ld)\n", "input buffers", "", report -> inputBytes, report -> inputPeakBytes);
+}
+
+// [Build]assignCascadeRanks
+// Looks up where each selector of each ruleset sits in the cascade index,
+// once for the ruleset's normal declarations and once for its !important
+// ones. The ranks of ruleset i's selector j are ranks[(rankStart[i] + j) * 2]
+// and the next slot, -1 when the ruleset has no declarations of that kind.
+void assignCascadeRanks(Build* build) {
+  SyntaxNode* stylesheet = build -> stylesheet;
+  build -> rankStart = (int*)malloc(sizeof(int) * (stylesheet -> list.length + 1));
+  build -> rankStart[0] = 0;
+  for (int i = 0; i < stylesheet -> list.length; i++) {
+    SyntaxNode* ruleset = (SyntaxNode*)stylesheet -> list.items[i];
+    build -> rankStart[i + 1] = build -> rankStart[i] + ruleset -> left -> list.length;
+  }
+  int slots = build -> rankStart[stylesheet -> list.length] * 2;
+  build -> ranks = (int*)malloc(sizeof(int) * (slots + 1));
+  for (int i = 0; i < slots; i++) {
+    build -> ranks[i] = -1;
+  }
+  for (int i = 0; i < build -> cascade.length; i++) {
+    CascadeEntry* entry = &build -> cascade.entries[i];
+    build -> ranks[(build -> rankStart[entry -> order] + entry -> selectorIndex) * 2 + entry -> important] = i;
+  }
+}
+
+// [Build]haveRanksChanged
+// Whether a kept rule's selectors moved in the cascade between two builds.
+// Ranks are positions in the whole index, so adding or removing any rule can
+// shift those of rules that did not change.
+int haveRanksChanged(Build* previous, int before, Build* next, int after) {
+  int count = next -> rankStart[after + 1] - next -> rankStart[after];
+  if (previous -> rankStart[before + 1] - previous -> rankStart[before] != count) {
+    return TRUE;
+  }
+  int* beforeRanks = &previous -> ranks[previous -> rankStart[before] * 2];
+  int* afterRanks = &next -> ranks[next -> rankStart[after] * 2];
+  return memcmp(beforeRanks, afterRanks, sizeof(int) * count * 2) != 0;
+}
+
+// [Build]assignRuleIds
+// A ruleset is identified by a 64 bit hash of its selector text, so it keeps
+// its id across rebuilds as long as its selectors do. Rulesets whose hashes
+// are equal, because they share selector text or collide, are told apart by
+// how many came before them, so every id in a build is unique.
+char** assignRuleIds(SyntaxNode* stylesheet) {
+  char** ids = (char**)malloc(sizeof(char*) * stylesheet -> list.length);
+  PointerMap occurrences = {NULL, NULL, 0, 0};
+  Buffer buffer = {NULL, 0, 0};
+  char id[48];
+  for (int i = 0; i < stylesheet -> list.length; i++) {
+    SyntaxNode* ruleset = (SyntaxNode*)stylesheet -> list.items[i];
+    buffer.length = 0;
+    writeSelectorList(&buffer, ruleset -> left);
+    unsigned long long hash = hashBytes64(HASH_SEED_64, buffer.chars, buffer.length);
+    snprintf(id, sizeof(id), "%016llx", hash);
+    char* base = internString(id, strlen(id));
+    int occurrence = getPointerMap(&occurrences, base, 0);
+    putPointerMap(&occurrences, base, occurrence + 1);
+    if (occurrence > 0) {
+      snprintf(id, sizeof(id), "%016llx-%d", hash, occurrence);
+    }
+    ids[i] = internString(id, strlen(id));
+  }
+  freePointerMap(&occurrences);
+  free(buffer.chars);
+  return ids;
+}
+
+void appendBuffer(Buffer* buffer, const char* chars, int length) {
+  if (length == 0) {
+    return;
+  }
+  if (buffer -> length + length + 1 > buffer -> capacity) {
+    int capacity = buffer -> capacity == 0 ? 256 : buffer -> capacity;
+    while (buffer -> length + length + 1 > capacity) {
+      capacity *= 2;
+    }
+    buffer -> chars = (char*)realloc(buffer -> chars, capacity);
+    buffer -> capacity = capacity;
+  }
+  memcpy(&buffer -> chars[buffer -> length], chars, length);
+  buffer -> length += length;
+  buffer -> chars[buffer -> length] = '\0';
+}
+
+void appendString(Buffer* buffer, const char* chars) {
+  appendBuffer(buffer, chars, strlen(chars));
+}
+
+// [Emit]appendQuoted
+// Appends text as a double quoted JavaScript string literal.
+void appendQuoted(Buffer* buffer, const char* chars) {
+  appendBuffer(buffer, "\"", 1);
+  for (const char* ch = chars; *ch != '\0'; ch++) {
+    if (*ch == '"' || *ch == '\\') {
+      appendBuffer(buffer, "\\", 1);
+    }
+    appendBuffer(buffer, ch, 1);
+  }
+  appendBuffer(buffer, "\"", 1);
+}
+
+void writeSimpleSelector(Buffer* buffer, SyntaxNode* node) {
+  if (node == NULL) {
+    return;
+  }
+  if (node -> type == NodeType_Identifier) {
+    appendString(buffer, node -> token.chars);
+    return;
+  }
+  writeSimpleSelector(buffer, node -> left);
+  SyntaxNode* part = node -> right;
+  if (part == NULL) {
+    return;
+  }
+  switch (part -> type) {
+    case NodeType_Class:
+      appendString(buffer, ".");
+      appendString(buffer, part -> token.chars);
+      break;
+    case NodeType_Id:
+      appendString(buffer, "#");
+      appendString(buffer, part -> token.chars);
+      break;
+    case NodeType_Psuedo:
+      appendString(buffer, ":");
+      appendString(buffer, part -> token.chars);
+      break;
+    case NodeType_Data_Attribute:
+      appendString(buffer, "[");
+      appendString(buffer, part -> token.chars);
+      if (part -> right != NULL) {
+        appendString(buffer, part -> right -> token.chars);
+        appendString(buffer, part -> right -> left -> token.chars);
+      }
+      appendString(buffer, "]");
+      break;
+    default:
+      break;
+  }
+}
+
+void writeSelector(Buffer* buffer, Selector* selector) {
+  writeSimpleSelector(buffer, selector -> simpleSelector);
+  if (selector -> selector == NULL) {
+    return;
+  }
+  if (selector -> combinator != NULL) {
+    appendString(buffer, " ");
+    appendString(buffer, selector -> combinator -> token.chars);
+  }
+  appendString(buffer, " ");
+  writeSelector(buffer, selector -> selector);
+}
+
+void writeSelectorList(Buffer* buffer, SyntaxNode* selectors) {
+  for (int i = 0; i < selectors -> list.length; i++) {
+    if (i > 0) {
+      appendString(buffer, ", ");
+    }
+    writeSelector(buffer, (Selector*)selectors -> list.items[i]);
+  }
+}
+
+void writeExpression(Buffer* buffer, SyntaxNode* node) {
+  if (node == NULL) {
+    return;
+  }
+  if (node -> type == NodeType_Expression) {
+    writeExpression(buffer, node -> left);
+    appendString(buffer, " ");
+    appendString(buffer, node -> token.chars);
+    appendString(buffer, " ");
+    writeExpression(buffer, node -> right);
+    return;
+  }
+  appendString(buffer, node -> token.chars);
+  if (node -> left != NULL) {
+    appendString(buffer, node -> left -> token.chars);
+  }
+}
+
+void writeRank(Buffer* buffer, int rank) {
+  char number[16];
+  if (rank == -1) {
+    appendString(buffer, "null");
+    return;
+  }
+  snprintf(number, sizeof(number), "%d", rank);
+  appendString(buffer, number);
+}
+
+// [Emit]writeRule
+// Writes one ruleset as the object literal the runtime loads:
+// {id, selectors: [{text, specificity, rank, importantRank}], declarations: [{property, value, important}], plan}
+void writeRule(Buffer* buffer, Build* build, int index) {
+  SyntaxNode* ruleset = (SyntaxNode*)build -> stylesheet -> list.items[index];
+  Buffer text = {NULL, 0, 0};
+  char number[16];
+  appendString(buffer, "{id: ");
+  appendQuoted(buffer, build -> ruleIds[index]);
+  appendString(buffer, ", selectors: [");
+  for (int i = 0; i < ruleset -> left -> list.length; i++) {
+    Selector* selector = (Selector*)ruleset -> left -> list.items[i];
+    text.length = 0;
+    writeSelector(&text, selector);
+    snprintf(number, sizeof(number), "%d", selector -> specificity);
+    appendString(buffer, i > 0 ? ", {text: " : "{text: ");
+    appendQuoted(buffer, text.chars);
+    appendString(buffer, ", specificity: ");
+    appendString(buffer, number);
+    appendString(buffer, ", rank: ");
+    writeRank(buffer, build -> ranks[(build -> rankStart[index] + i) * 2]);
+    appendString(buffer, ", importantRank: ");
+    writeRank(buffer, build -> ranks[(build -> rankStart[index] + i) * 2 + 1]);
+    appendString(buffer, "}");
+  }
+  appendString(buffer, "], declarations: [");
+  for (int i = 0; i < ruleset -> right -> list.length; i++) {
+    Declaration* declaration = (Declaration*)ruleset -> right -> list.items[i];
+    text.length = 0;
+    writeExpression(&text, declaration -> expression);
+    appendString(buffer, i > 0 ? ", {property: " : "{property: ");
+    appendQuoted(buffer, declaration -> property -> token.chars);
+    appendString(buffer, ", value: ");
+    appendQuoted(buffer, text.chars);
+    appendString(buffer, declaration -> important ? ", important: true}" : ", important: false}");
+  }
+  appendString(buffer, "], plan: ");
+  writePlan(buffer, &build -> plans[index]);
+  appendString(buffer, "}");
+  free(text.chars);
+}
+
+// [Emit]emitStylesheet
+// Writes a full build to the output file, replacing whatever was there. The
+// output is always a snapshot of the current build, tagged with its version.
+int emitStylesheet(char const* path, Build* build) {
+  Buffer buffer = {NULL, 0, 0};
+  appendString(&buffer, "//KAPPA-KCSS: CONSTRAINT BASED CSS\n");
+  appendString(&buffer, "//CREATED WITH \xF0\x9F\x92\x96 @ https://github.com/KappaDesigns/Kappa-KCSS\n");
+  appendString(&buffer, "KCSS.load([\n");
+  for (int i = 0; i < build -> stylesheet -> list.length; i++) {
+    appendString(&buffer, "  ");
+    writeRule(&buffer, build, i);
+    appendString(&buffer, ",\n");
+  }
+  char version[64];
+  snprintf(version, sizeof(version), "], {version: %d});\n", build -> version);
+  appendString(&buffer, version);
+  int written = writeOutput(path, "w", &buffer);
+  free(buffer.chars);
+  return written;
+}
+
+// [Emit]emitPatch
+// Diffs a rebuild against the previous build by rule id and writes a
+// KCSS.patch call with only the rules that were added, removed or changed to
+// its own file, which takes the build one version past the previous one.
+// Because nodes are hash-consed a rule changed exactly when its declaration
+// block pointer did. A rule whose position relative to the other kept rules
+// moved is sent as removed and added again, so the runtime can keep its rules
+// in cascade order. Kept rules whose declarations are the same but whose
+// cascade ranks moved are listed with their new ranks only. Returns the
+// number of changed rules; nothing is written when that is zero.
+int emitPatch(char const* path, Build* previous, Build* next) {
+  PointerMap previousIndex = {NULL, NULL, 0, 0};
+  int* kept = (int*)calloc(previous -> stylesheet -> list.length + 1, sizeof(int));
+  Buffer added = {NULL, 0, 0};
+  Buffer removed = {NULL, 0, 0};
+  Buffer changed = {NULL, 0, 0};
+  Buffer ranks = {NULL, 0, 0};
+  int changes = 0;
+  int lastIndex = -1;
+  for (int i = 0; i < previous -> stylesheet -> list.length; i++) {
+    putPointerMap(&previousIndex, previous -> ruleIds[i], i);
+  }
+  for (int i = 0; i < next -> stylesheet -> list.length; i++) {
+    int index = getPointerMap(&previousIndex, next -> ruleIds[i], -1);
+    if (index > lastIndex) {
+      SyntaxNode* before = (SyntaxNode*)previous -> stylesheet -> list.items[index];
+      SyntaxNode* after = (SyntaxNode*)next -> stylesheet -> list.items[i];
+      kept[index] = TRUE;
+      lastIndex = index;
+      if (before -> right != after -> right) {
+        appendString(&changed, changed.length > 0 ? ",\n    " : "\n    ");
+        writeRule(&changed, next, i);
+        changes++;
+      } else if (haveRanksChanged(previous, index, next, i)) {
+        appendString(&ranks, ranks.length > 0 ? ",\n    {id: " : "\n    {id: ");
+        appendQuoted(&ranks, next -> ruleIds[i]);
+        for (int important = 0; important < 2; important++) {
+          appendString(&ranks, important ? "], importantRank: [" : ", rank: [");
+          for (int j = next -> rankStart[i]; j < next -> rankStart[i + 1]; j++) {
+            appendString(&ranks, j > next -> rankStart[i] ? ", " : "");
+            writeRank(&ranks, next -> ranks[j * 2 + important]);
+          }
+        }
+        appendString(&ranks, "]}");
+        changes++;
+      }
+      continue;
+    }
+    appendString(&added, added.length > 0 ? ",\n    {after: " : "\n    {after: ");
+    if (i == 0) {
+      appendString(&added, "null");
+    } else {
+      appendQuoted(&added, next -> ruleIds[i - 1]);
+    }
+    appendString(&added, ", rule: ");
+    writeRule(&added, next, i);
+    appendString(&added, "}");
+    changes++;
+  }
+  for (int i = 0; i < previous -> stylesheet -> list.length; i++) {
+    if (!kept[i]) {
+      appendString(&removed, removed.length > 0 ? ", " : "");
+      appendQuoted(&removed, previous -> ruleIds[i]);
+      changes++;
+    }
+  }
+
+  int written = 0;
+  if (changes > 0) {
+    Buffer buffer = {NULL, 0, 0};
+    char version[64];
+    snprintf(version, sizeof(version), "KCSS.patch({version: %d,\n", next -> version);
+    appendString(&buffer, version);
+    appendString(&buffer, "  removed: [");
+    appendBuffer(&buffer, removed.chars, removed.length);
+    appendString(&buffer, "],\n  added: [");
+    appendBuffer(&buffer, added.chars, added.length);
+    appendString(&buffer, added.length > 0 ? "\n  ],\n  changed: [" : "],\n  changed: [");
+    appendBuffer(&buffer, changed.chars, changed.length);
+    appendString(&buffer, changed.length > 0 ? "\n  ],\n  ranks: [" : "],\n  ranks: [");
+    appendBuffer(&buffer, ranks.chars, ranks.length);
+    appendString(&buffer, ranks.length > 0 ? "\n  ]\n});\n" : "]\n});\n");
+    written = writeOutput(path, "w", &buffer);
+    free(buffer.chars);
+  }
+  freePointerMap(&previousIndex);
+  free(kept);
+  free(added.chars);
+  free(removed.chars);
+  free(changed.chars);
+  free(ranks.chars);
+  return written ? changes : 0;
+}
+
+int writeOutput(char const* path, char const* mode, Buffer* buffer) {
+  FILE* file = fopen(path, mode);
+  if (!file) {
+    printf("Output File \"%s\" Could Not Be Written.\n", path);
+    return FALSE;
+  }
+  fwrite(buffer -> chars, sizeof(char), buffer -> length, file);
+  fclose(file);
+  return TRUE;
+}
+
+// [API]defaultOutputPath
+// Returns the input path with its .kcss ending swapped for .js.
+char* defaultOutputPath(char const* path) {
+  int dotIndex = lastIndexOf(path, '.');
+  char* outputPath = (char*)malloc(sizeof(char) * (dotIndex + 4));
+  memcpy(outputPath, path, dotIndex);
+  strcpy(&outputPath[dotIndex], ".js");
+  return outputPath;
+}
+
+// [API]patchOutputPath
+// Returns the file a patch of an output is written to, the output path with
+// .patch.<version> put before its .js ending, e.g. site.patch.3.js.
+char* patchOutputPath(char const* path, char const* version) {
+  int length = strlen(path);
+  if (length >= 3 && strcmp(&path[length - 3], ".js") == 0) {
+    length -= 3;
+  }
+  char* patchPath = (char*)malloc(sizeof(char) * (length + strlen(version) + 11));
+  memcpy(patchPath, path, length);
+  sprintf(&patchPath[length], ".patch.%s.js", version);
+  return patchPath;
+}
+
+// [API]removePatchFile
+// Deletes one old patch of an output, so a long watch session keeps only the
+// last PATCH_HISTORY patches next to the snapshot.
+void removePatchFile(char const* path, int version) {
+  if (version < 1) {
+    return;
+  }
+  char number[16];
+  snprintf(number, sizeof(number), "%d", version);
+  char* patchPath = patchOutputPath(path, number);
+  remove(patchPath);
+  free(patchPath);
+}
+
+// [API]removePatchFiles
+// Deletes every patch left next to an output by an earlier watch session,
+// before a full build starts the versions over.
+void removePatchFiles(char const* path) {
+  char* pattern = patchOutputPath(path, "[0-9]*");
+  glob_t paths;
+  if (glob(pattern, 0, NULL, &paths) == 0) {
+    for (size_t i = 0; i < paths.gl_pathc; i++) {
+      remove(paths.gl_pathv[i]);
+    }
+    globfree(&paths);
+  }
+  free(pattern);
+}
+
+// [Intern]hashBytes
+// FNV-1a over a run of bytes. Takes the running hash so composite keys can be
+// hashed one field at a time, starting from HASH_SEED.
+unsigned int hashBytes(unsigned int hash, const void* bytes, int length) {
+  const unsigned char* data = (const unsigned char*)bytes;
+  for (int i = 0; i < length; i++) {
+    hash ^= data[i];
+    hash *= HASH_PRIME;
+  }
+  return hash;
+}
+
+unsigned int hashPointer(unsigned int hash, const void* pointer) {
+  return hashBytes(hash, &pointer, sizeof(pointer));
+}
+
+// [Intern]hashBytes64
+// 64 bit FNV-1a, for hashes that have to stay unique across a whole
+// stylesheet rather than spread items over a table.
+unsigned long long hashBytes64(unsigned long long hash, const void* bytes, int length) {
+  const unsigned char* data = (const unsigned char*)bytes;
+  for (int i = 0; i < length; i++) {
+    hash ^= data[i];
+    hash *= HASH_PRIME_64;
+  }
+  return hash;
+}
+
+void growInternTable(InternTable* table) {
+  int capacity = table -> capacity == 0 ? 64 : table -> capacity * 2;
+  void** items = (void**)calloc(capacity, sizeof(void*));
+  unsigned int* hashes = (unsigned int*)calloc(capacity, sizeof(unsigned int));
+  for (int i = 0; i < table -> capacity; i++) {
+    if (table -> items[i] != NULL) {
+      int index = table -> hashes[i] & (capacity - 1);
+      while (items[index] != NULL) {
+        index = (index + 1) & (capacity - 1);
+      }
+      items[index] = table -> items[i];
+      hashes[index] = table -> hashes[i];
+    }
+  }
+  free(table -> items);
+  free(table -> hashes);
+  table -> items = items;
+  table -> hashes = hashes;
+  table -> capacity = capacity;
+}
+
+// [Intern]findInternSlot
+// Looks up the slot for a key in an open addressed intern table. Returns the
+// slot holding the canonical item when one matches, otherwise the empty slot
+// it should be stored in with fillInternSlot.
+void** findInternSlot(InternTable* table, unsigned int hash, const void* key, int (*matches)(const void* key, const void* item)) {
+  if ((table -> length + 1) * 2 > table -> capacity) {
+    growInternTable(table);
+  }
+  int index = hash & (table -> capacity - 1);
+  while (table -> items[index] != NULL) {
+    if (table -> hashes[index] == hash && matches(key, table -> items[index])) {
+      return &table -> items[index];
+    }
+    index = (index + 1) & (table -> capacity - 1);
+  }
+  return &table -> items[index];
+}
+
+void fillInternSlot(InternTable* table, void** slot, unsigned int hash, void* item) {
+  int index = slot - table -> items;
+  table -> items[index] = item;
+  table -> hashes[index] = hash;
+  table -> length++;
+}
+
+int matchesString(const void* key, const void* item) {
+  const Slice* slice = (const Slice*)key;
+  const char* chars = (const char*)item;
+  return strncmp(chars, slice -> chars, slice -> length) == 0 && chars[slice -> length] == '\0';
+}
+
+// [Intern]internString
+// Returns the canonical copy of a run of characters, so every token with the
+// same text shares one allocation.
+char* internString(char* chars, int length) {
+  Slice slice = {chars, length};
+  unsigned int hash = hashBytes(HASH_SEED, chars, length);
+  void** slot = findInternSlot(&stringTable, hash, &slice, matchesString);
+  if (*slot != NULL) {
+    return (char*)*slot;
+  }
+  char* str = (char*)malloc(sizeof(char) * (length + 1));
+  for (int i = 0; i < length; i++) {
+    str[i] = chars[i];
+  }
+  str[length] = '\0';
+  fillInternSlot(&stringTable, slot, hash, str);
+  return str;
+}
+
+unsigned int hashNode(const SyntaxNode* node) {
+  unsigned int hash = hashBytes(HASH_SEED, &node -> type, sizeof(NodeType));
+  hash = hashBytes(hash, &node -> token.type, sizeof(TokenType));
+  if (node -> token.chars != NULL) {
+    hash = hashBytes(hash, node -> token.chars, strlen(node -> token.chars));
+  }
+  hash = hashPointer(hash, node -> left);
+  hash = hashPointer(hash, node -> right);
+  for (int i = 0; i < node -> list.length; i++) {
+    hash = hashPointer(hash, node -> list.items[i]);
+  }
+  return hash;
+}
+
+int matchesNode(const void* key, const void* item) {
+  const SyntaxNode* a = (const SyntaxNode*)key;
+  const SyntaxNode* b = (const SyntaxNode*)item;
+  if (a -> type != b -> type || a -> token.type != b -> token.type) {
+    return FALSE;
+  }
+  if (a -> token.chars != b -> token.chars) {
+    if (a -> token.chars == NULL || b -> token.chars == NULL) {
+      return FALSE;
+    }
+    if (strcmp(a -> token.chars, b -> token.chars) != 0) {
+      return FALSE;
+    }
+  }
+  if (a -> left != b -> left || a -> right != b -> right) {
+    return FALSE;
+  }
+  if (a -> list.length != b -> list.length) {
+    return FALSE;
+  }
+  for (int i = 0; i < a -> list.length; i++) {
+    if (a -> list.items[i] != b -> list.items[i]) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// [Intern]internNode
+// Hash-conses a fully built node. Children must already be canonical, so two
+// subtrees are equal exactly when their fields and child pointers are. When an
+// equal node already exists the passed node is freed and the canonical one is
+// returned, so callers must not touch a node after interning it.
+SyntaxNode* internNode(SyntaxNode* node) {
+  unsigned int hash = hashNode(node);
+  logParseAllocation(node, PARSE_RELEASED);
+  void** slot = findInternSlot(&nodeTable, hash, node, matchesNode);
+  if (*slot != NULL) {
+    free(node -> list.items);
+    free(node);
+    return (SyntaxNode*)*slot;
+  }
+  fillInternSlot(&nodeTable, slot, hash, node);
+  return node;
+}
+
+int matchesDeclaration(const void* key, const void* item) {
+  const Declaration* a = (const Declaration*)key;
+  const Declaration* b = (const Declaration*)item;
+  return (
+    a -> property == b -> property &&
+    a -> expression == b -> expression &&
+    a -> important == b -> important
+  );
+}
+
+Declaration* internDeclaration(Declaration* declaration) {
+  unsigned int hash = hashPointer(HASH_SEED, declaration -> property);
+  hash = hashPointer(hash, declaration -> expression);
+  hash = hashBytes(hash, &declaration -> important, sizeof(int));
+  logParseAllocation(declaration, PARSE_RELEASED);
+  void** slot = findInternSlot(&declarationTable, hash, declaration, matchesDeclaration);
+  if (*slot != NULL) {
+    free(declaration);
+    return (Declaration*)*slot;
+  }
+  fillInternSlot(&declarationTable, slot, hash, declaration);
+  return declaration;
+}
+
+int matchesSelector(const void* key, const void* item) {
+  const Selector* a = (const Selector*)key;
+  const Selector* b = (const Selector*)item;
+  return (
+    a -> simpleSelector == b -> simpleSelector &&
+    a -> combinator == b -> combinator &&
+    a -> selector == b -> selector
+  );
+}
+
+Selector* internSelector(Selector* selector) {
+  unsigned int hash = hashPointer(HASH_SEED, selector -> simpleSelector);
+  hash = hashPointer(hash, selector -> combinator);
+  hash = hashPointer(hash, selector -> selector);
+  logParseAllocation(selector, PARSE_RELEASED);
+  void** slot = findInternSlot(&selectorTable, hash, selector, matchesSelector);
+  if (*slot != NULL) {
+    free(selector);
+    return (Selector*)*slot;
+  }
+  fillInternSlot(&selectorTable, slot, hash, selector);
+  return selector;
+}
+
+int findPointerMapIndex(PointerMap* map, const void* key) {
+  int index = hashPointer(HASH_SEED, key) & (map -> capacity - 1);
+  while (map -> keys[index] != NULL && map -> keys[index] != key) {
+    index = (index + 1) & (map -> capacity - 1);
+  }
+  return index;
+}
+
+int getPointerMap(PointerMap* map, const void* key, int fallback) {
+  if (map -> capacity == 0) {
+    return fallback;
+  }
+  int index = findPointerMapIndex(map, key);
+  return map -> keys[index] == NULL ? fallback : map -> values[index];
+}
+
+void putPointerMap(PointerMap* map, const void* key, int value) {
+  if ((map -> length + 1) * 2 > map -> capacity) {
+    PointerMap grown = {NULL, NULL, map -> capacity == 0 ? 64 : map -> capacity * 2, 0};
+    grown.keys = (void**)calloc(grown.capacity, sizeof(void*));
+    grown.values = (int*)calloc(grown.capacity, sizeof(int));
+    for (int i = 0; i < map -> capacity; i++) {
+      if (map -> keys[i] != NULL) {
+        int index = findPointerMapIndex(&grown, map -> keys[i]);
+        grown.keys[index] = map -> keys[i];
+        grown.values[index] = map -> values[i];
+        grown.length++;
+      }
+    }
+    freePointerMap(map);
+    *map = grown;
+  }
+  int index = findPointerMapIndex(map, key);
+  if (map -> keys[index] == NULL) {
+    map -> keys[index] = (void*)key;
+    map -> length++;
+  }
+  map -> values[index] = value;
+}
+
+void freePointerMap(PointerMap* map) {
+  free(map -> keys);
+  free(map -> values);
+  map -> keys = NULL;
+  map -> values = NULL;
+  map -> capacity = 0;
+  map -> length = 0;
+}
+
+// [Optimizer]optimizeStylesheet
+// Runs the structural passes over a parsed stylesheet. Nodes are hash-consed
+// while reading, so every equality check in these passes is a pointer compare.
+void optimizeStylesheet(SyntaxNode* stylesheet) {
+  for (int i = 0; i < stylesheet -> list.length; i++) {
+    SyntaxNode* ruleset = (SyntaxNode*)stylesheet -> list.items[i];
+    ruleset -> right = dropOverriddenDeclarations(ruleset -> right);
+  }
+  mergeIdenticalRulesets(stylesheet);
+}
+
+// [Optimizer]dropOverriddenDeclarations
+// Removes declarations that lose to another declaration of the same property
+// in the same ruleset: the last !important one if there is any, otherwise the
+// last one. Returns the canonical declaration block, which is the passed one
+// when nothing was dropped.
+SyntaxNode* dropOverriddenDeclarations(SyntaxNode* declarations) {
+  PointerMap lastIndex = {NULL, NULL, 0, 0};
+  Declaration** items = (Declaration**)declarations -> list.items;
+  int kept = 0;
+  for (int i = 0; i < declarations -> list.length; i++) {
+    int winner = getPointerMap(&lastIndex, items[i] -> property, -1);
+    if (winner == -1 || items[i] -> important || !items[winner] -> important) {
+      putPointerMap(&lastIndex, items[i] -> property, i);
+    }
+  }
+  for (int i = 0; i < declarations -> list.length; i++) {
+    if (getPointerMap(&lastIndex, items[i] -> property, -1) == i) {
+      kept++;
+    }
+  }
+  if (kept == declarations -> list.length) {
+    freePointerMap(&lastIndex);
+    return declarations;
+  }
+  SyntaxNode* node = createNode(NodeType_Declaration);
+  node -> list.items = (void**)malloc(sizeof(void*) * kept);
+  for (int i = 0; i < declarations -> list.length; i++) {
+    if (getPointerMap(&lastIndex, items[i] -> property, -1) == i) {
+      node -> list.items[node -> list.length++] = items[i];
+    }
+  }
+  freePointerMap(&lastIndex);
+  return internNode(node);
+}
+
+// [Optimizer]mergeIdenticalRulesets
+// Folds rulesets that share a declaration block into the first of them by
+// joining their selector lists. A later ruleset is only moved up when no
+// ruleset in between declares any of the same properties, so the cascade
+// result is unchanged.
+void mergeIdenticalRulesets(SyntaxNode* stylesheet) {
+  int count = stylesheet -> list.length;
+  SyntaxNode** rulesets = (SyntaxNode**)stylesheet -> list.items;
+  int* nextMember = (int*)malloc(sizeof(int) * count);
+  int* lastMember = (int*)malloc(sizeof(int) * count);
+  int* isMerged = (int*)malloc(sizeof(int) * count);
+  PointerMap survivors = {NULL, NULL, 0, 0};
+  PointerMap lastDeclared = {NULL, NULL, 0, 0};
+  for (int i = 0; i < count; i++) {
+    SyntaxNode* declarations = rulesets[i] -> right;
+    Declaration** items = (Declaration**)declarations -> list.items;
+    int survivor = getPointerMap(&survivors, declarations, -1);
+    int canMerge = survivor != -1;
+    for (int j = 0; canMerge && j < declarations -> list.length; j++) {
+      if (getPointerMap(&lastDeclared, items[j] -> property, -1) > survivor) {
+        canMerge = FALSE;
+      }
+    }
+    nextMember[i] = -1;
+    lastMember[i] = i;
+    isMerged[i] = canMerge;
+    if (canMerge) {
+      nextMember[lastMember[survivor]] = i;
+      lastMember[survivor] = i;
+      continue;
+    }
+    putPointerMap(&survivors, declarations, i);
+    for (int j = 0; j < declarations -> list.length; j++) {
+      putPointerMap(&lastDeclared, items[j] -> property, i);
+    }
+  }
+
+  PointerMap seen = {NULL, NULL, 0, 0};
+  int length = 0;
+  for (int i = 0; i < count; i++) {
+    if (nextMember[i] != -1 && !isMerged[i]) {
+      rulesets[i] -> left = mergeSelectorLists(rulesets, nextMember, i, &seen);
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (isMerged[i]) {
+      free(rulesets[i]);
+    } else {
+      rulesets[length++] = rulesets[i];
+    }
+  }
+  stylesheet -> list.length = length;
+  freePointerMap(&seen);
+  freePointerMap(&survivors);
+  freePointerMap(&lastDeclared);
+  free(nextMember);
+  free(lastMember);
+  free(isMerged);
+}
+
+// [Cascade]readSpecificity
+// Counts the id, class and type selectors in a compound selector as it comes
+// out of readSimpleSelector. Attributes and pseudo classes weigh as classes,
+// the legacy single colon pseudo elements as types, and the universal
+// selector not at all.
+int readSpecificity(SyntaxNode* simpleSelector) {
+  int specificity = 0;
+  for (SyntaxNode* node = simpleSelector; node != NULL; node = node -> left) {
+    if (node -> type == NodeType_Identifier) {
+      if (strcmp(node -> token.chars, "*") != 0) {
+        specificity = addSpecificity(specificity, SPECIFICITY_TYPE);
+      }
+      continue;
+    }
+    SyntaxNode* part = node -> right;
+    if (part == NULL) {
+      continue;
+    }
+    switch (part -> type) {
+      case NodeType_Id:
+        specificity = addSpecificity(specificity, SPECIFICITY_ID);
+        break;
+      case NodeType_Psuedo:
+        if (
+          strcmp(part -> token.chars, "before") == 0 ||
+          strcmp(part -> token.chars, "after") == 0 ||
+          strcmp(part -> token.chars, "first-line") == 0 ||
+          strcmp(part -> token.chars, "first-letter") == 0
+        ) {
+          specificity = addSpecificity(specificity, SPECIFICITY_TYPE);
+        } else {
+          specificity = addSpecificity(specificity, SPECIFICITY_CLASS);
+        }
+        break;
+      default:
+        specificity = addSpecificity(specificity, SPECIFICITY_CLASS);
+        break;
+    }
+  }
+  return specificity;
+}
+
+// [Cascade]addSpecificity
+// Specificity is packed as ids, classes and types in ten bits each, so it
+// compares as a single int. Each count saturates instead of carrying over.
+int addSpecificity(int specificity, int amount) {
+  if ((specificity / amount) % (SPECIFICITY_MAX + 1) == SPECIFICITY_MAX) {
+    return specificity;
+  }
+  return specificity + amount;
+}
+
+// [Cascade]combineSpecificity
+// Adds up the specificities of the compounds of a complex selector field by
+// field, saturating each like addSpecificity.
+int combineSpecificity(int left, int right) {
+  int amounts[] = {SPECIFICITY_ID, SPECIFICITY_CLASS, SPECIFICITY_TYPE};
+  int specificity = 0;
+  for (int i = 0; i < 3; i++) {
+    int count = (left / amounts[i]) % (SPECIFICITY_MAX + 1) + (right / amounts[i]) % (SPECIFICITY_MAX + 1);
+    specificity += (count > SPECIFICITY_MAX ? SPECIFICITY_MAX : count) * amounts[i];
+  }
+  return specificity;
+}
+
+// [Cascade]buildCascadeIndex
+// Lists every selector of every ruleset once for its normal declarations and
+// once for its !important ones, sorted from weakest to strongest by
+// importance, specificity and source order. An entry's position is its rank:
+// when several rules match an element the declaration from the highest ranked
+// entry wins, so resolving a conflict is a max instead of a sort.
+CascadeIndex buildCascadeIndex(SyntaxNode* stylesheet) {
+  CascadeIndex index = {NULL, 0};
+  int size = 0;
+  for (int i = 0; i < stylesheet -> list.length; i++) {
+    SyntaxNode* ruleset = (SyntaxNode*)stylesheet -> list.items[i];
+    size += ruleset -> left -> list.length * 2;
+  }
+  index.entries = (CascadeEntry*)malloc(sizeof(CascadeEntry) * size);
+  for (int i = 0; i < stylesheet -> list.length; i++) {
+    SyntaxNode* ruleset = (SyntaxNode*)stylesheet -> list.items[i];
+    int hasNormal = FALSE;
+    int hasImportant = FALSE;
+    for (int j = 0; j < ruleset -> right -> list.length; j++) {
+      if (((Declaration*)ruleset -> right -> list.items[j]) -> important) {
+        hasImportant = TRUE;
+      } else {
+        hasNormal = TRUE;
+      }
+    }
+    for (int j = 0; j < ruleset -> left -> list.length; j++) {
+      CascadeEntry entry = {(Selector*)ruleset -> left -> list.items[j], ruleset, FALSE, i, j};
+      if (hasNormal) {
+        index.entries[index.length++] = entry;
+      }
+      if (hasImportant) {
+        entry.important = TRUE;
+        index.entries[index.length++] = entry;
+      }
+    }
+  }
+  qsort(index.entries, index.length, sizeof(CascadeEntry), compareCascadeEntries);
+  return index;
+}
+
+int compareCascadeEntries(const void* a, const void* b) {
+  const CascadeEntry* left = (const CascadeEntry*)a;
+  const CascadeEntry* right = (const CascadeEntry*)b;
+  if (left -> important != right -> important) {
+    return left -> important - right -> important;
+  }
+  if (left -> selector -> specificity != right -> selector -> specificity) {
+    return left -> selector -> specificity < right -> selector -> specificity ? -1 : 1;
+  }
+  if (left -> order != right -> order) {
+    return left -> order - right -> order;
+  }
+  return 0;
+}
+
+// [Optimizer]mergeSelectorLists
+// Builds the joined selector list for a surviving ruleset and every ruleset
+// chained onto it, dropping selectors that already appear in the group.
+SyntaxNode* mergeSelectorLists(SyntaxNode** rulesets, int* nextMember, int survivor, PointerMap* seen) {
+  int size = 0;
+  for (int i = survivor; i != -1; i = nextMember[i]) {
+    size += rulesets[i] -> left -> list.length;
+  }
+  SyntaxNode* node = createNode(NodeType_Selector);
+  node -> list.items = (void**)malloc(sizeof(void*) * size);
+  for (int i = survivor; i != -1; i = nextMember[i]) {
+    SyntaxNode* selectors = rulesets[i] -> left;
+    for (int j = 0; j < selectors -> list.length; j++) {
+      if (getPointerMap(seen, selectors -> list.items[j], -1) != survivor) {
+        putPointerMap(seen, selectors -> list.items[j], survivor);
+        node -> list.items[node -> list.length++] = selectors -> list.items[j];
+      }
+    }
+  }
+  return internNode(node);
+}
+
+TokenStream* readFile(FILE* file) {
+  TokenStream* stream = (TokenStream*)malloc(sizeof(TokenStream));
+  int size;
+  int ch;
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char* chars = (char*)malloc(sizeof(char) * (size + 1));
+  for (int i = 0; i < size; i++) {
+    ch = fgetc(file);
+    chars[i] = (char)ch;
+  }
+  chars[size] = '\0';
+  inputBytes += size + 1;
+  if (inputBytes > inputPeakBytes) {
+    inputPeakBytes = inputBytes;
+  }
+  stream -> chars = chars;
+  stream -> offset = 0;
+  stream -> length = size;
+  advance(stream);
+  return stream;
+}
+
+Token nextToken(TokenStream* stream, TokenType type) {
+  Token token = currentToken(stream);
+  if (token.type != type) {
+    parseError("[error] expected:%d actual:%d offset:%d \n", type, token.type, stream -> offset);
+  }
+  advance(stream);
+  return token;
+}
+
+//[Tokens] readToken
+Token readToken(TokenStream* stream) {
+  if (stream -> offset == stream -> length) {
+    return token_eof;
+  }
+
+  char ch = stream->chars[stream->offset];
+  if (isspace(ch)) {
+    return readWhiteSpaceToken(stream);
+  }
+  if (ch == '\"' || ch == '\'') {
+    return readStringToken(stream, ch);
+  }
+  if (isalpha(ch)) {
+    return readIndentifierToken(stream);
+  }
+  if (isdigit(ch)) {
+    return readNumberToken(stream);
+  }
+  for (int i = 0; i < sizeof(tokens) / sizeof(Token); i++) {
+    if (strncmp(tokens[i].chars, &stream -> chars[stream -> offset], strlen(tokens[i].chars)) == 0) {
+      stream -> offset += strlen(tokens[i].chars);
+      return tokens[i];
+    }
+  }
+  Token token = createToken(&stream -> chars[stream -> offset], 1, TokenType_Unknown);
+  stream->offset ++;
+  return token;
+}
+
+Token readWhiteSpaceToken(TokenStream* stream) {
+  Token token = createToken(&stream -> chars[stream -> offset], 1, TokenType_WhiteSpace);
+  stream -> offset ++;
+  return token;
+}
+
+Token readIndentifierToken(TokenStream* stream) {
+  int offset = stream->offset;
+  while (isalnum(stream->chars[offset]) || stream->chars[offset] == '-') {
+    offset++;
+  }
+  Token token = createToken(&stream->chars[stream->offset], offset - stream -> offset, TokenType_Identifier);
+  stream -> offset = offset;
+  return token;
+}
+
+Token readNumberToken(TokenStream* stream) {
+  int offset = stream->offset;
+  while(isdigit(stream->chars[offset])) {
+    offset++;
+  }
+  Token token = createToken(&stream->chars[stream->offset], offset - stream -> offset, TokenType_Number);
+  stream -> offset = offset;
+  return token;
+}
+
+Token readStringToken(TokenStream* stream, char quoteType) {
+  int offset = stream->offset + 1;
+  while(offset < stream -> length && stream->chars[offset] != quoteType) {
+    offset++;
+  }
+  if (offset == stream -> length) {
+    Token token = createToken(&stream->chars[stream->offset], offset - stream -> offset, TokenType_Unknown);
+    stream -> offset = offset;
+    return token;
+  }
+  offset++;
+  Token token = createToken(&stream->chars[stream->offset], offset - stream -> offset, TokenType_String);
+  stream -> offset = offset;
+  return token;
+}
+
+Token currentToken(TokenStream* stream) {
+  return stream -> currentToken;
 }
 
 void advance(TokenStream* stream) {
@@ -734,12 +3102,7 @@ void advance(TokenStream* stream) {
 //[Token]createToken
 Token createToken(char* chars, int length, TokenType tokenType) {
   Token token;
-  char* str = (char*)malloc(sizeof(char) * (length + 1));
-  for (int i = 0; i < length; i++) {
-    str[i] = chars[i];
-  }
-  str[length] = '\0';
-  token.chars = str;
+  token.chars = internString(chars, length);
   token.type = tokenType;
   return token;
 }
@@ -825,12 +3188,1077 @@ int printWatchingFiles() {
 
 // [API]haveFilesChanged
 // Returns whether or not there have been changes to the KCSS files. IF there
-// have TRUE is returned otherwise FALSE is returned.
-int haveFilesChanged(char const* path) {
-  return FALSE;
+// have TRUE is returned otherwise FALSE is returned. Changes are detected by
+// each file's modification time, to the nanosecond, and size since it was last
+// read, and every changed file is printed. The files of the last successful
+// build are polled along with those of a failed one, and so are the paths a
+// failed build could not find, which count as changed once they exist.
+int haveFilesChanged(Project* project) {
+  int changed = FALSE;
+  for (int i = 0; i < project -> missingCount; i++) {
+    struct stat info;
+    if (stat(project -> missing[i], &info) == 0) {
+      printDetectedChanges(project -> missing[i]);
+      changed = TRUE;
+    }
+  }
+  for (int i = 0; i < project -> length; i++) {
+    SourceFile* source = &project -> files[i];
+    struct stat info;
+    if (!(source -> visited || source -> watched) || stat(source -> path, &info) != 0) {
+      continue;
+    }
+    struct timespec modifiedTime = readModifiedTime(&info);
+    if (
+      modifiedTime.tv_sec != source -> modifiedTime.tv_sec ||
+      modifiedTime.tv_nsec != source -> modifiedTime.tv_nsec ||
+      info.st_size != source -> modifiedSize
+    ) {
+      printDetectedChanges(source -> path);
+      changed = TRUE;
+    }
+  }
+  return changed;
+}
+
+// [API]readModifiedTime
+// Modification time of a file with nanoseconds, so two saves within the same
+// second are told apart.
+struct timespec readModifiedTime(struct stat* info) {
+#ifdef __APPLE__
+  return info -> st_mtimespec;
+#else
+  return info -> st_mtim;
+#endif
 }
 
 // [API]printDetectedChanges
-int printDetectedChanges() {
+int printDetectedChanges(char const* path) {
+  printf(">>> Detected Changes In \"%s\". Rebuilding...\n", path);
+  return 0;
+}
+
+// [Validate]buildValidator
+// Indexes the class and id names used by any selector of a stylesheet, keyed
+// by their interned text. Selectors whose subject, the compound after the
+// last combinator, names a class or id are listed for hit counting, chained
+// by the first such name so an element only looks at selectors it can match.
+// When a cascade index is passed, each selector that is a single compound of
+// classes and ids, and so is matched exactly, is given its ranks in it.
+Validator buildValidator(SyntaxNode* stylesheet, CascadeIndex* cascade) {
+  Validator validator;
+  PointerMap seen = {NULL, NULL, 0, 0};
+  int selectorCapacity = 0;
+  int nameCapacity = 0;
+  memset(&validator, 0, sizeof(Validator));
+  for (int i = 0; i < stylesheet -> list.length; i++) {
+    SyntaxNode* selectors = ((SyntaxNode*)stylesheet -> list.items[i]) -> left;
+    for (int j = 0; j < selectors -> list.length; j++) {
+      Selector* selector = (Selector*)selectors -> list.items[j];
+      if (getPointerMap(&seen, selector, FALSE)) {
+        continue;
+      }
+      putPointerMap(&seen, selector, TRUE);
+      int subjectLength = 0;
+      int* subject = NULL;
+      int exact = selector -> selector == NULL;
+      for (; selector != NULL; selector = selector -> selector) {
+        int isSubject = selector -> selector == NULL;
+        for (SyntaxNode* node = selector -> simpleSelector; node != NULL; node = node -> left) {
+          if (node -> right == NULL || (node -> right -> type != NodeType_Class && node -> right -> type != NodeType_Id)) {
+            exact = FALSE;
+            continue;
+          }
+          int isClass = node -> right -> type == NodeType_Class;
+          PointerMap* names = isClass ? &validator.classes : &validator.ids;
+          int name = getPointerMap(names, node -> right -> token.chars, -1);
+          if (name == -1) {
+            if (validator.nameCount == nameCapacity) {
+              nameCapacity = nameCapacity == 0 ? 64 : nameCapacity * 2;
+              validator.names = (char**)realloc(validator.names, sizeof(char*) * nameCapacity);
+              validator.isClass = (int*)realloc(validator.isClass, sizeof(int) * nameCapacity);
+              validator.firstWithKey = (int*)realloc(validator.firstWithKey, sizeof(int) * nameCapacity);
+            }
+            name = validator.nameCount++;
+            validator.names[name] = node -> right -> token.chars;
+            validator.isClass[name] = isClass;
+            validator.firstWithKey[name] = -1;
+            putPointerMap(names, node -> right -> token.chars, name);
+          }
+          if (isSubject) {
+            subject = (int*)realloc(subject, sizeof(int) * (subjectLength + 2));
+            subject[subjectLength++] = name;
+            subject[subjectLength] = -1;
+          }
+        }
+      }
+      if (subject == NULL) {
+        continue;
+      }
+      if (validator.selectorCount == selectorCapacity) {
+        selectorCapacity = selectorCapacity == 0 ? 64 : selectorCapacity * 2;
+        validator.selectors = (Selector**)realloc(validator.selectors, sizeof(Selector*) * selectorCapacity);
+        validator.subjectNames = (int**)realloc(validator.subjectNames, sizeof(int*) * selectorCapacity);
+        validator.nextWithKey = (int*)realloc(validator.nextWithKey, sizeof(int) * selectorCapacity);
+        validator.exact = (int*)realloc(validator.exact, sizeof(int) * selectorCapacity);
+      }
+      int index = validator.selectorCount++;
+      validator.selectors[index] = (Selector*)selectors -> list.items[j];
+      validator.subjectNames[index] = subject;
+      validator.exact[index] = exact;
+      validator.nextWithKey[index] = validator.firstWithKey[subject[0]];
+      validator.firstWithKey[subject[0]] = index;
+    }
+  }
+  freePointerMap(&seen);
+  if (cascade == NULL) {
+    return validator;
+  }
+
+  PointerMap indices = {NULL, NULL, 0, 0};
+  validator.cascade = cascade;
+  validator.rankStart = (int*)calloc(validator.selectorCount + 2, sizeof(int));
+  for (int i = 0; i < validator.selectorCount; i++) {
+    putPointerMap(&indices, validator.selectors[i], i);
+  }
+  for (int i = 0; i < cascade -> length; i++) {
+    int index = getPointerMap(&indices, cascade -> entries[i].selector, -1);
+    if (index != -1 && validator.exact[index]) {
+      validator.rankStart[index + 2]++;
+    }
+  }
+  for (int i = 2; i <= validator.selectorCount + 1; i++) {
+    validator.rankStart[i] += validator.rankStart[i - 1];
+  }
+  validator.ranks = (int*)malloc(sizeof(int) * (validator.rankStart[validator.selectorCount + 1] + 1));
+  for (int i = 0; i < cascade -> length; i++) {
+    int index = getPointerMap(&indices, cascade -> entries[i].selector, -1);
+    if (index != -1 && validator.exact[index]) {
+      validator.ranks[validator.rankStart[index + 1]++] = i;
+    }
+  }
+  validator.declarationStart = (int*)malloc(sizeof(int) * (stylesheet -> list.length + 1));
+  validator.declarationStart[0] = 0;
+  for (int i = 0; i < stylesheet -> list.length; i++) {
+    SyntaxNode* declarations = ((SyntaxNode*)stylesheet -> list.items[i]) -> right;
+    validator.declarationStart[i + 1] = validator.declarationStart[i] + declarations -> list.length;
+  }
+  validator.declarationCount = validator.declarationStart[stylesheet -> list.length];
+  freePointerMap(&indices);
+  return validator;
+}
+
+void freeValidator(Validator* validator) {
+  freePointerMap(&validator -> classes);
+  freePointerMap(&validator -> ids);
+  for (int i = 0; i < validator -> selectorCount; i++) {
+    free(validator -> subjectNames[i]);
+  }
+  free(validator -> selectors);
+  free(validator -> subjectNames);
+  free(validator -> nextWithKey);
+  free(validator -> exact);
+  free(validator -> names);
+  free(validator -> isClass);
+  free(validator -> firstWithKey);
+  free(validator -> rankStart);
+  free(validator -> ranks);
+  free(validator -> declarationStart);
+}
+
+// [Validate]createValidationCounts
+// Zeroed per thread counters sized for a validator.
+ValidationCounts createValidationCounts(Validator* validator) {
+  ValidationCounts counts;
+  memset(&counts, 0, sizeof(ValidationCounts));
+  counts.applied = (long*)calloc(validator -> declarationCount + 1, sizeof(long));
+  counts.wins = (long*)calloc(validator -> declarationCount + 1, sizeof(long));
+  counts.hits = (long*)calloc(validator -> selectorCount + 1, sizeof(long));
+  counts.seen = (unsigned char*)calloc(validator -> nameCount + 1, sizeof(unsigned char));
+  return counts;
+}
+
+void freeValidationCounts(ValidationCounts* counts) {
+  free(counts -> hits);
+  free(counts -> seen);
+  free(counts -> names);
+  free(counts -> applied);
+  free(counts -> wins);
+  free(counts -> claimed);
+  free(counts -> claimedRank);
+  free(counts -> claimedDeclaration);
+}
+
+// [Intern]lookupString
+// Returns the canonical copy of a run of characters if it has been interned,
+// otherwise NULL. Unlike internString it never grows the table, so any number
+// of threads can look strings up while nothing is being interned.
+char* lookupString(const char* chars, int length) {
+  if (stringTable.capacity == 0) {
+    return NULL;
+  }
+  unsigned int hash = hashBytes(HASH_SEED, chars, length);
+  Slice slice = {chars, length};
+  int index = hash & (stringTable.capacity - 1);
+  while (stringTable.items[index] != NULL) {
+    if (stringTable.hashes[index] == hash && matchesString(&slice, stringTable.items[index])) {
+      return (char*)stringTable.items[index];
+    }
+    index = (index + 1) & (stringTable.capacity - 1);
+  }
+  return NULL;
+}
+
+// [Validate]checkHtmlName
+// Looks up one class or id of an element. Returns its name index, or -1 after
+// warning when no selector uses it.
+int checkHtmlName(Validator* validator, char const* name, const char* chars, int length, int isClass, Buffer* warnings) {
+  char* canonical = lookupString(chars, length);
+  PointerMap* names = isClass ? &validator -> classes : &validator -> ids;
+  int index = canonical == NULL ? -1 : getPointerMap(names, canonical, -1);
+  if (index == -1 && warnings != NULL) {
+    appendFormat(warnings, "[warning] %s: %s \"%.*s\" Is Not Defined In The Stylesheet.\n", name, isClass ? "class" : "id", length, chars);
+  }
+  return index;
+}
+
+// [Validate]countElement
+// Marks the names of one element as seen and counts a hit for every selector
+// whose subject names are all on it. With a cascade index, the declarations
+// of the exactly matched selectors are then resolved and the winner of each
+// property on the element is counted.
+void countElement(Validator* validator, ValidationCounts* counts) {
+  for (int i = 0; i < counts -> nameCount; i++) {
+    int name = counts -> names[i];
+    counts -> seen[name] = TRUE;
+    for (int selector = validator -> firstWithKey[name]; selector != -1; selector = validator -> nextWithKey[selector]) {
+      int matches = TRUE;
+      for (int* subject = validator -> subjectNames[selector] + 1; matches && *subject != -1; subject++) {
+        matches = FALSE;
+        for (int j = 0; j < counts -> nameCount; j++) {
+          if (counts -> names[j] == *subject) {
+            matches = TRUE;
+          }
+        }
+      }
+      counts -> hits[selector] += matches;
+      if (matches && validator -> cascade != NULL) {
+        for (int j = validator -> rankStart[selector]; j < validator -> rankStart[selector + 1]; j++) {
+          claimDeclarations(validator, counts, validator -> ranks[j]);
+        }
+      }
+    }
+  }
+  for (int i = 0; i < counts -> claimedCount; i++) {
+    counts -> wins[counts -> claimedDeclaration[i]]++;
+  }
+  counts -> claimedCount = 0;
+  counts -> nameCount = 0;
+}
+
+// [Validate]claimDeclarations
+// Offers the declarations of one matched cascade entry to the current element.
+// Each property goes to the highest ranked entry declaring it, so resolving
+// the cascade for an element is a running max over its entries' ranks.
+void claimDeclarations(Validator* validator, ValidationCounts* counts, int rank) {
+  CascadeEntry* entry = &validator -> cascade -> entries[rank];
+  SyntaxNode* declarations = entry -> ruleset -> right;
+  for (int i = 0; i < declarations -> list.length; i++) {
+    Declaration* declaration = (Declaration*)declarations -> list.items[i];
+    if (declaration -> important != entry -> important) {
+      continue;
+    }
+    int index = validator -> declarationStart[entry -> order] + i;
+    int claim = 0;
+    counts -> applied[index]++;
+    while (claim < counts -> claimedCount && counts -> claimed[claim] != declaration -> property) {
+      claim++;
+    }
+    if (claim == counts -> claimedCount) {
+      if (counts -> claimedCount == counts -> claimedCapacity) {
+        counts -> claimedCapacity = counts -> claimedCapacity == 0 ? 16 : counts -> claimedCapacity * 2;
+        counts -> claimed = (SyntaxNode**)realloc(counts -> claimed, sizeof(SyntaxNode*) * counts -> claimedCapacity);
+        counts -> claimedRank = (int*)realloc(counts -> claimedRank, sizeof(int) * counts -> claimedCapacity);
+        counts -> claimedDeclaration = (int*)realloc(counts -> claimedDeclaration, sizeof(int) * counts -> claimedCapacity);
+      }
+      counts -> claimed[claim] = declaration -> property;
+      counts -> claimedRank[claim] = -1;
+      counts -> claimedCount++;
+    }
+    if (rank > counts -> claimedRank[claim]) {
+      counts -> claimedRank[claim] = rank;
+      counts -> claimedDeclaration[claim] = index;
+    }
+  }
+}
+
+// [Validate]addElementName
+// Adds a class or id to the current element, once however often it is
+// repeated, so a selector gets at most one hit per element.
+void addElementName(ValidationCounts* counts, int name) {
+  if (counts == NULL || name == -1) {
+    return;
+  }
+  for (int i = 0; i < counts -> nameCount; i++) {
+    if (counts -> names[i] == name) {
+      return;
+    }
+  }
+  if (counts -> nameCount == counts -> nameCapacity) {
+    counts -> nameCapacity = counts -> nameCapacity == 0 ? 16 : counts -> nameCapacity * 2;
+    counts -> names = (int*)realloc(counts -> names, sizeof(int) * counts -> nameCapacity);
+  }
+  counts -> names[counts -> nameCount++] = name;
+}
+
+// [Validate]validateHtml
+// Scans the tags of an HTML document for class and id attributes and warns
+// about every name no selector in the stylesheet uses. Warnings are appended
+// to warnings and selector hits and seen names added to counts, either of
+// which can be NULL. Only touches the validator and interned strings to read
+// them, so documents can be validated in parallel. Returns the number of
+// warnings.
+int validateHtml(Validator* validator, char const* name, const char* chars, int length, Buffer* warnings, ValidationCounts* counts) {
+  int count = 0;
+  int inTag = FALSE;
+  for (int i = 0; i < length; i++) {
+    if (chars[i] == '<') {
+      inTag = TRUE;
+      continue;
+    }
+    if (chars[i] == '>') {
+      inTag = FALSE;
+      if (counts != NULL) {
+        countElement(validator, counts);
+      }
+      continue;
+    }
+    if (!inTag || !isspace(chars[i])) {
+      continue;
+    }
+    int isClass = strncmp(&chars[i + 1], "class=", 6) == 0 && i + 7 < length;
+    int isId = strncmp(&chars[i + 1], "id=", 3) == 0 && i + 4 < length;
+    if (!isClass && !isId) {
+      continue;
+    }
+    int start = i + (isClass ? 7 : 4);
+    char quote = chars[start];
+    int end = start;
+    if (quote == '"' || quote == '\'') {
+      start++;
+      end = start;
+      while (end < length && chars[end] != quote) {
+        end++;
+      }
+    } else {
+      while (end < length && !isspace(chars[end]) && chars[end] != '>') {
+        end++;
+      }
+    }
+    if (isId) {
+      int index = checkHtmlName(validator, name, &chars[start], end - start, FALSE, warnings);
+      count += index == -1;
+      addElementName(counts, index);
+    } else {
+      for (int j = start; j < end;) {
+        while (j < end && isspace(chars[j])) {
+          j++;
+        }
+        int wordStart = j;
+        while (j < end && !isspace(chars[j])) {
+          j++;
+        }
+        if (j > wordStart) {
+          int index = checkHtmlName(validator, name, &chars[wordStart], j - wordStart, TRUE, warnings);
+          count += index == -1;
+          addElementName(counts, index);
+        }
+      }
+    }
+    i = quote == '"' || quote == '\'' ? end : end - 1;
+  }
+  return count;
+}
+
+// [Validate]runValidation
+// Validates many HTML documents against one stylesheet:
+// gcss input.kcss --validate page.html 'pages/*.html' @list.txt [-j threads]
+// Arguments are glob patterns, or files listing one path per line when they
+// start with @. Documents are spread over the threads' deques up front and
+// threads that run dry steal from the others, since pages vary widely in
+// size. Each thread keeps its own hit counts and seen names and merges them
+// with atomic adds when it is done. Warnings are printed per file in argument
+// order, followed by the hit count of every selector and the stylesheet names
+// no document used.
+int runValidation(char const* inputPath, int argc, char const* argv[], int index) {
+  Project project = {NULL, 0, 0, {NULL, NULL, 0, 0}, FALSE, NULL, 0, 0};
+  SyntaxNode* stylesheet = loadProjectStylesheet(&project, inputPath);
+  if (stylesheet == NULL) {
+    return 1;
+  }
+  Build build = buildStylesheet(stylesheet, 0);
+  ValidationPool pool;
+  memset(&pool, 0, sizeof(ValidationPool));
+  pool.validator = buildValidator(build.stylesheet, &build.cascade);
+  pool.threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  glob_t paths;
+  int globFlags = GLOB_NOCHECK;
+  memset(&paths, 0, sizeof(glob_t));
+  for (int i = index + 1; i < argc; i++) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      pool.threads = atoi(argv[++i]);
+    } else if (argv[i][0] == '@') {
+      FILE* list = fopen(&argv[i][1], "r");
+      char line[PATH_MAX];
+      if (!list) {
+        printf("File List \"%s\" Does Not Exist. Exiting...\n", &argv[i][1]);
+        return 1;
+      }
+      while (fgets(line, sizeof(line), list) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] != '\0') {
+          glob(line, globFlags, NULL, &paths);
+          globFlags |= GLOB_APPEND;
+        }
+      }
+      fclose(list);
+    } else {
+      glob(argv[i], globFlags, NULL, &paths);
+      globFlags |= GLOB_APPEND;
+    }
+  }
+  if (pool.threads < 1) {
+    pool.threads = 1;
+  }
+  pool.paths = paths.gl_pathv;
+  pool.fileCount = paths.gl_pathc;
+  pool.warnings = (Buffer*)calloc(pool.fileCount + 1, sizeof(Buffer));
+  pool.warningCounts = (int*)calloc(pool.fileCount + 1, sizeof(int));
+  pool.hits = (long*)calloc(pool.validator.selectorCount + 1, sizeof(long));
+  pool.seen = (unsigned char*)calloc(pool.validator.nameCount + 1, sizeof(unsigned char));
+  pool.applied = (long*)calloc(pool.validator.declarationCount + 1, sizeof(long));
+  pool.wins = (long*)calloc(pool.validator.declarationCount + 1, sizeof(long));
+  pool.deques = (WorkDeque*)calloc(pool.threads, sizeof(WorkDeque));
+  for (int i = 0; i < pool.threads; i++) {
+    pool.deques[i].tasks = (int*)malloc(sizeof(int) * (pool.fileCount / pool.threads + 1));
+  }
+  for (int i = 0; i < pool.fileCount; i++) {
+    WorkDeque* deque = &pool.deques[i % pool.threads];
+    deque -> tasks[deque -> bottom++] = i;
+  }
+
+  pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * pool.threads);
+  ValidationWorker* workers = (ValidationWorker*)calloc(pool.threads, sizeof(ValidationWorker));
+  for (int i = 0; i < pool.threads; i++) {
+    workers[i].pool = &pool;
+    workers[i].id = i;
+    pthread_create(&threads[i], NULL, runValidationWorker, &workers[i]);
+  }
+  for (int i = 0; i < pool.threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  int warnings = 0;
+  for (int i = 0; i < pool.fileCount; i++) {
+    if (pool.warnings[i].length > 0) {
+      fwrite(pool.warnings[i].chars, sizeof(char), pool.warnings[i].length, stdout);
+    }
+    warnings += pool.warningCounts[i];
+    free(pool.warnings[i].chars);
+  }
+  Buffer text = {NULL, 0, 0};
+  printf(">>> Selector Hits:\n");
+  for (int i = 0; i < pool.validator.selectorCount; i++) {
+    text.length = 0;
+    writeSelector(&text, pool.validator.selectors[i]);
+    printf("%10ld  %s\n", pool.hits[i], text.chars);
+  }
+  for (int i = 0; i < pool.validator.nameCount; i++) {
+    if (!pool.seen[i]) {
+      printf("[warning] %s \"%s\" Is Never Used.\n", pool.validator.isClass[i] ? "class" : "id", pool.validator.names[i]);
+    }
+  }
+  for (int i = 0; i < build.stylesheet -> list.length; i++) {
+    SyntaxNode* ruleset = (SyntaxNode*)build.stylesheet -> list.items[i];
+    for (int j = 0; j < ruleset -> right -> list.length; j++) {
+      int declaration = pool.validator.declarationStart[i] + j;
+      if (pool.applied[declaration] > 0 && pool.wins[declaration] == 0) {
+        text.length = 0;
+        writeSelectorList(&text, ruleset -> left);
+        printf("[warning] %s: \"%s\" Is Overridden On Every Element It Applies To.\n", text.chars, ((Declaration*)ruleset -> right -> list.items[j]) -> property -> token.chars);
+      }
+    }
+  }
+  printf(">>> Validated %d Files With %d Warnings On %d Threads.\n", pool.fileCount, warnings, pool.threads);
+  free(text.chars);
+  for (int i = 0; i < pool.threads; i++) {
+    free(pool.deques[i].tasks);
+  }
+  free(pool.deques);
+  free(pool.warnings);
+  free(pool.warningCounts);
+  free(pool.hits);
+  free(pool.seen);
+  free(pool.applied);
+  free(pool.wins);
+  free(threads);
+  free(workers);
+  freeValidator(&pool.validator);
+  globfree(&paths);
+  return 0;
+}
+
+// [Validate]popWork
+// Takes a task from the owner's end of its own deque. Tasks are only added
+// before the threads start, so the deque never grows and the owner only has
+// to race a thief for the last task.
+int popWork(WorkDeque* deque) {
+  long bottom = __atomic_load_n(&deque -> bottom, __ATOMIC_SEQ_CST) - 1;
+  __atomic_store_n(&deque -> bottom, bottom, __ATOMIC_SEQ_CST);
+  long top = __atomic_load_n(&deque -> top, __ATOMIC_SEQ_CST);
+  if (top > bottom) {
+    __atomic_store_n(&deque -> bottom, top, __ATOMIC_SEQ_CST);
+    return -1;
+  }
+  int task = deque -> tasks[bottom];
+  if (top == bottom) {
+    if (!__atomic_compare_exchange_n(&deque -> top, &top, top + 1, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      task = -1;
+    }
+    __atomic_store_n(&deque -> bottom, top + 1, __ATOMIC_SEQ_CST);
+  }
+  return task;
+}
+
+// [Validate]stealWork
+// Takes a task from the other end of someone else's deque. Returns -1 when it
+// is empty and -2 when another thread won the race, in which case the deque
+// may still hold work.
+int stealWork(WorkDeque* deque) {
+  long top = __atomic_load_n(&deque -> top, __ATOMIC_SEQ_CST);
+  long bottom = __atomic_load_n(&deque -> bottom, __ATOMIC_SEQ_CST);
+  if (top >= bottom) {
+    return -1;
+  }
+  int task = deque -> tasks[top];
+  if (!__atomic_compare_exchange_n(&deque -> top, &top, top + 1, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    return -2;
+  }
+  return task;
+}
+
+void* runValidationWorker(void* argument) {
+  ValidationWorker* worker = (ValidationWorker*)argument;
+  ValidationPool* pool = worker -> pool;
+  ValidationCounts counts = createValidationCounts(&pool -> validator);
+  while (TRUE) {
+    int task = popWork(&pool -> deques[worker -> id]);
+    int contended = FALSE;
+    for (int i = 1; task < 0 && i < pool -> threads; i++) {
+      task = stealWork(&pool -> deques[(worker -> id + i) % pool -> threads]);
+      contended |= task == -2;
+    }
+    if (task < 0) {
+      if (contended) {
+        continue;
+      }
+      break;
+    }
+    validateHtmlFile(pool, task, &counts);
+  }
+  for (int i = 0; i < pool -> validator.selectorCount; i++) {
+    if (counts.hits[i] != 0) {
+      __atomic_fetch_add(&pool -> hits[i], counts.hits[i], __ATOMIC_RELAXED);
+    }
+  }
+  for (int i = 0; i < pool -> validator.nameCount; i++) {
+    if (counts.seen[i]) {
+      __atomic_store_n(&pool -> seen[i], TRUE, __ATOMIC_RELAXED);
+    }
+  }
+  for (int i = 0; i < pool -> validator.declarationCount; i++) {
+    if (counts.applied[i] != 0) {
+      __atomic_fetch_add(&pool -> applied[i], counts.applied[i], __ATOMIC_RELAXED);
+      __atomic_fetch_add(&pool -> wins[i], counts.wins[i], __ATOMIC_RELAXED);
+    }
+  }
+  freeValidationCounts(&counts);
+  return NULL;
+}
+
+void validateHtmlFile(ValidationPool* pool, int task, ValidationCounts* counts) {
+  char const* path = pool -> paths[task];
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    appendFormat(&pool -> warnings[task], "[warning] %s: File Does Not Exist.\n", path);
+    pool -> warningCounts[task] = 1;
+    return;
+  }
+  TokenStream* document = readDocument(file);
+  fclose(file);
+  pool -> warningCounts[task] = validateHtml(&pool -> validator, path, document -> chars, document -> length, &pool -> warnings[task], counts);
+  free(document -> chars);
+  free(document);
+}
+
+// [Validate]readDocument
+// Reads a whole file like readFile, without lexing its first token.
+TokenStream* readDocument(FILE* file) {
+  TokenStream* stream = (TokenStream*)malloc(sizeof(TokenStream));
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  stream -> chars = (char*)malloc(sizeof(char) * (size + 1));
+  stream -> length = fread(stream -> chars, sizeof(char), size, file);
+  stream -> chars[stream -> length] = '\0';
+  stream -> offset = 0;
+  return stream;
+}
+
+// [Project]loadProjectStylesheet
+// Loads a root file and its imports into one stylesheet without emitting
+// anything. Returns NULL when a file is missing or fails to parse, or the
+// imports form a cycle.
+SyntaxNode* loadProjectStylesheet(Project* project, char const* inputPath) {
+  int root = loadSourceFile(project, inputPath);
+  int* stack = (int*)malloc(sizeof(int) * (project -> length + 1));
+  if (root == -1 || findImportCycle(project, root, stack, 0)) {
+    free(stack);
+    return NULL;
+  }
+  free(stack);
+  int* included = (int*)calloc(project -> length, sizeof(int));
+  SyntaxNode* stylesheet = createNode(NodeType_Stylesheet);
+  int size = flattenSourceFile(project, root, included, NULL, 0);
+  if (size == -1) {
+    free(included);
+    freeStylesheet(stylesheet);
+    return NULL;
+  }
+  memset(included, 0, sizeof(int) * project -> length);
+  stylesheet -> list.items = (void**)malloc(sizeof(void*) * (size + 1));
+  stylesheet -> list.length = flattenSourceFile(project, root, included, stylesheet -> list.items, 0);
+  free(included);
+  return stylesheet;
+}
+
+// [Generator]nextRandom
+// xorshift32, so a generated corpus depends only on its seed.
+unsigned int nextRandom(unsigned int* state) {
+  unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+void appendFormat(Buffer* buffer, const char* format, ...) {
+  char chars[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(chars, sizeof(chars), format, args);
+  va_end(args);
+  appendBuffer(buffer, chars, length < (int)sizeof(chars) ? length : (int)sizeof(chars) - 1);
+}
+
+void generateCompound(Buffer* buffer, GeneratorOptions* options, unsigned int* state) {
+  static const char* elements[] = {"div", "p", "span", "a", "li", "ul", "section", "header"};
+  static const char* psuedos[] = {"hover", "focus", "active", "first-child", "visited"};
+  int hasElement = nextRandom(state) % 2 == 0;
+  if (hasElement) {
+    appendString(buffer, elements[nextRandom(state) % 8]);
+  }
+  switch (nextRandom(state) % (hasElement ? 4 : 3)) {
+    case 0:
+      appendFormat(buffer, "#i%u", nextRandom(state) % options -> vocabulary);
+      break;
+    case 1:
+      appendFormat(buffer, ".c%u:%s", nextRandom(state) % options -> vocabulary, psuedos[nextRandom(state) % 5]);
+      break;
+    case 2:
+      appendFormat(buffer, ".c%u", nextRandom(state) % options -> vocabulary);
+      break;
+    default:
+      break;
+  }
+}
+
+void generateSelector(Buffer* buffer, GeneratorOptions* options, unsigned int* state) {
+  static const char* combinators[] = {" ", " > ", " + "};
+  static const char* assigners[] = {"=", "~=", "|=", "^=", "$=", "*="};
+  for (int i = 0; i <= options -> combinators; i++) {
+    if (i > 0) {
+      appendString(buffer, combinators[nextRandom(state) % 3]);
+    }
+    generateCompound(buffer, options, state);
+  }
+  for (int i = 0; i < options -> attributes; i++) {
+    unsigned int attribute = nextRandom(state) % options -> vocabulary;
+    if (nextRandom(state) % 3 == 0) {
+      appendFormat(buffer, "[data-a%u]", attribute);
+    } else {
+      appendFormat(buffer, "[data-a%u%s\"v%u\"]", attribute, assigners[nextRandom(state) % 6], nextRandom(state) % 16);
+    }
+  }
+}
+
+// [Generator]generateDeclarations
+// About one block in four repeats the block of an earlier ruleset, the way
+// generated stylesheets tend to repeat themselves; the rest are new. Whether
+// a ruleset repeats, and which one, depends only on its index and the seed,
+// so the share stays the same however many rulesets a target size takes and
+// a repeat follows the earlier ruleset back to the block it printed. Values mix
+// lengths, keywords, strings and expressions over other properties of the
+// block, some of them cyclic.
+void generateDeclarations(Buffer* buffer, GeneratorOptions* options, int ruleset) {
+  static const char* properties[] = {
+    "width", "height", "top", "left", "right", "bottom", "margin", "padding",
+    "min-width", "max-width", "line-height", "font-size", "gap", "opacity", "z-index", "color"
+  };
+  int block = ruleset;
+  while (block > 0) {
+    unsigned int draw = ((block + 1) * 2246822519u ^ options -> seed) | 1;
+    nextRandom(&draw);
+    if ((nextRandom(&draw) >> 16) % 4 != 0) {
+      break;
+    }
+    block = nextRandom(&draw) % block;
+  }
+  unsigned int local = (block + 1) * 2654435761u ^ options -> seed;
+  if (local == 0) {
+    local = 1;
+  }
+  for (int i = 0; i < options -> declarations; i++) {
+    const char* property = properties[nextRandom(&local) % 16];
+    appendFormat(buffer, "  %s: ", property);
+    switch (nextRandom(&local) % 6) {
+      case 0:
+        appendFormat(buffer, "%s * 2", properties[nextRandom(&local) % 16]);
+        break;
+      case 1:
+        appendFormat(buffer, "%s + %upx", properties[nextRandom(&local) % 16], nextRandom(&local) % 64);
+        break;
+      case 2:
+        appendString(buffer, "auto");
+        break;
+      case 3:
+        appendString(buffer, "\"none\"");
+        break;
+      default:
+        appendFormat(buffer, "%upx", nextRandom(&local) % 1024);
+        break;
+    }
+    appendString(buffer, nextRandom(&local) % 20 == 0 ? " !important\n" : "\n");
+  }
+}
+
+// [Generator]generateStylesheet
+// Writes options -> rulesets rulesets, or as many as it takes to reach
+// targetBytes when that is not zero.
+void generateStylesheet(Buffer* buffer, GeneratorOptions* options, long targetBytes) {
+  unsigned int state = options -> seed == 0 ? 1 : options -> seed;
+  for (int i = 0; targetBytes > 0 ? buffer -> length < targetBytes : i < options -> rulesets; i++) {
+    for (int j = 0; j < options -> selectors; j++) {
+      if (j > 0) {
+        appendString(buffer, ",\n");
+      }
+      generateSelector(buffer, options, &state);
+    }
+    appendString(buffer, " {\n");
+    generateDeclarations(buffer, options, i);
+    appendString(buffer, "}\n");
+  }
+}
+
+// [Generator]generatePage
+// Writes an HTML page of options -> elements elements using the same class
+// and id names as the stylesheet, with about one name in twenty undefined.
+void generatePage(Buffer* buffer, GeneratorOptions* options, int page) {
+  static const char* elements[] = {"div", "p", "span", "a", "li", "section"};
+  unsigned int state = (options -> seed ^ (page + 1) * 2246822519u) | 1;
+  appendString(buffer, "<!DOCTYPE html>\n<html>\n<body>\n");
+  for (int i = 0; i < options -> elements; i++) {
+    const char* element = elements[nextRandom(&state) % 6];
+    appendFormat(buffer, "<%s class=\"", element);
+    int classes = nextRandom(&state) % 3 + 1;
+    for (int j = 0; j < classes; j++) {
+      char prefix = nextRandom(&state) % 20 == 0 ? 'u' : 'c';
+      appendFormat(buffer, j > 0 ? " %c%u" : "%c%u", prefix, nextRandom(&state) % options -> vocabulary);
+    }
+    appendString(buffer, "\"");
+    if (nextRandom(&state) % 4 == 0) {
+      char prefix = nextRandom(&state) % 20 == 0 ? 'u' : 'i';
+      appendFormat(buffer, " id=\"%c%u\"", prefix, nextRandom(&state) % options -> vocabulary);
+    }
+    appendFormat(buffer, ">item %d</%s>\n", i, element);
+  }
+  appendString(buffer, "</body>\n</html>\n");
+}
+
+GeneratorOptions defaultGeneratorOptions() {
+  GeneratorOptions options;
+  options.rulesets = 1000;
+  options.selectors = 2;
+  options.combinators = 1;
+  options.attributes = 1;
+  options.declarations = 4;
+  options.pages = 8;
+  options.elements = 200;
+  options.vocabulary = 200;
+  options.seed = 1;
+  return options;
+}
+
+// [Generator]readGeneratorOption
+// Reads one --name value pair into options. Returns FALSE when argv[index] is
+// not a generator option.
+int readGeneratorOption(GeneratorOptions* options, int argc, char const* argv[], int index) {
+  const char* names[] = {
+    "--rulesets", "--selectors", "--combinators", "--attributes",
+    "--declarations", "--pages", "--elements", "--vocabulary", "--seed"
+  };
+  int* values[] = {
+    &options -> rulesets, &options -> selectors, &options -> combinators, &options -> attributes,
+    &options -> declarations, &options -> pages, &options -> elements, &options -> vocabulary, NULL
+  };
+  if (index + 1 >= argc) {
+    return FALSE;
+  }
+  for (int i = 0; i < 9; i++) {
+    if (strcmp(argv[index], names[i]) != 0) {
+      continue;
+    }
+    if (values[i] == NULL) {
+      options -> seed = strtoul(argv[index + 1], NULL, 10);
+    } else {
+      *values[i] = atoi(argv[index + 1]);
+    }
+    if (options -> vocabulary < 1) {
+      options -> vocabulary = 1;
+    }
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// [Generator]generateCorpus
+// Writes index.kcss and page-N.html into a directory.
+int generateCorpus(char const* directory, GeneratorOptions* options) {
+  char* path = (char*)malloc(sizeof(char) * (strlen(directory) + 32));
+  Buffer buffer = {NULL, 0, 0};
+  mkdir(directory, 0755);
+  generateStylesheet(&buffer, options, 0);
+  sprintf(path, "%s/index.kcss", directory);
+  int written = writeOutput(path, "w", &buffer);
+  for (int i = 0; written && i < options -> pages; i++) {
+    buffer.length = 0;
+    generatePage(&buffer, options, i);
+    sprintf(path, "%s/page-%d.html", directory, i);
+    written = writeOutput(path, "w", &buffer);
+  }
+  free(buffer.chars);
+  free(path);
+  return written;
+}
+
+double currentSeconds() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// [Bench]resetPeakMemory
+// Resets this process's high-water mark to its current resident set, so the
+// next peakMemory covers only what runs after it. Works on Linux by writing
+// 5 to /proc/self/clear_refs and returns FALSE where that is not available.
+int resetPeakMemory() {
+  FILE* file = fopen("/proc/self/clear_refs", "w");
+  if (!file) {
+    return FALSE;
+  }
+  int written = fputs("5", file) >= 0;
+  return fclose(file) == 0 && written;
+}
+
+// [Bench]peakMemory
+// Peak resident set of this process in KB. Reads VmHWM on Linux, which
+// resetPeakMemory can lower, and falls back to ru_maxrss elsewhere.
+long peakMemory() {
+  FILE* file = fopen("/proc/self/status", "r");
+  if (file) {
+    char line[256];
+    long peak = -1;
+    while (peak == -1 && fgets(line, sizeof(line), file) != NULL) {
+      sscanf(line, "VmHWM: %ld", &peak);
+    }
+    fclose(file);
+    if (peak != -1) {
+      return peak;
+    }
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// [Bench]recordStage
+// Prints one measurement and appends it to the results file as
+// label, bytes, stage, seconds, MB/s and peak KB separated by tabs. The peak
+// is the high-water mark of the stage's own process since the stage began,
+// which includes the inputs it holds. When the
+// file already holds the same size and stage under another label, the latest
+// one is printed alongside for comparison.
+void recordStage(BenchRun* run, char const* stage, long bytes, double seconds) {
+  double throughput = seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0;
+  long peak = peakMemory();
+  char line[512];
+  char previous[512] = "";
+  FILE* file = fopen(run -> resultsPath, "r");
+  if (file) {
+    char label[128];
+    char name[32];
+    long size;
+    double oldSeconds, oldThroughput;
+    long oldPeak;
+    while (fgets(line, sizeof(line), file) != NULL) {
+      if (sscanf(line, "%127s %ld %31s %lf %lf %ld", label, &size, name, &oldSeconds, &oldThroughput, &oldPeak) == 6 &&
+          size == run -> bytes && strcmp(name, stage) == 0 && strcmp(label, run -> label) != 0) {
+        snprintf(previous, sizeof(previous), "  (%s: %.1f MB/s, %ld KB)", label, oldThroughput, oldPeak);
+      }
+    }
+    fclose(file);
+  }
+  printf("%10ld  %-8s %10.4fs %10.1f MB/s %10ld KB%s\n", run -> bytes, stage, seconds, throughput, peak, previous);
+  file = fopen(run -> resultsPath, "a");
+  if (file) {
+    fprintf(file, "%s\t%ld\t%s\t%.6f\t%.3f\t%ld\n", run -> label, run -> bytes, stage, seconds, throughput, peak);
+    fclose(file);
+  }
+  fflush(stdout);
+}
+
+// [Bench]benchStage
+// Times one stage over a generated stylesheet of about run -> bytes, and for
+// validate pages holding about as much HTML. Runs in its own process: the
+// stages it depends on are run untimed first, so no stage sees the intern
+// tables or memory another stage left behind, and the high-water mark is
+// reset just before the timed part. Lexing is timed as a separate pass; the
+// parse stage lexes again as it pulls tokens.
+void benchStage(BenchRun* run, GeneratorOptions* options, char const* stage) {
+  Buffer corpus = {NULL, 0, 0};
+  generateStylesheet(&corpus, options, run -> bytes);
+  FILE* file = tmpfile();
+  fwrite(corpus.chars, sizeof(char), corpus.length, file);
+  free(corpus.chars);
+
+  if (strcmp(stage, "read") == 0) {
+    resetPeakMemory();
+    double start = currentSeconds();
+    TokenStream* tokenStream = readFile(file);
+    recordStage(run, stage, tokenStream -> length, currentSeconds() - start);
+    fclose(file);
+    return;
+  }
+  TokenStream* tokenStream = readFile(file);
+  fclose(file);
+
+  if (strcmp(stage, "lex") == 0) {
+    TokenStream lexer = *tokenStream;
+    lexer.offset = 0;
+    resetPeakMemory();
+    double start = currentSeconds();
+    do {
+      advance(&lexer);
+    } while (lexer.currentToken.type != TokenType_EOF);
+    recordStage(run, stage, tokenStream -> length, currentSeconds() - start);
+    return;
+  }
+  if (strcmp(stage, "parse") == 0) {
+    resetPeakMemory();
+    double start = currentSeconds();
+    readStylesheet(tokenStream);
+    recordStage(run, stage, tokenStream -> length, currentSeconds() - start);
+    return;
+  }
+  SyntaxNode* stylesheet = readStylesheet(tokenStream);
+
+  if (strcmp(stage, "validate") == 0) {
+    Buffer* pages = (Buffer*)calloc(options -> pages, sizeof(Buffer));
+    GeneratorOptions pageOptions = *options;
+    pageOptions.elements = run -> bytes / (options -> pages * 40) + 1;
+    long pageBytes = 0;
+    for (int i = 0; i < options -> pages; i++) {
+      generatePage(&pages[i], &pageOptions, i);
+      pageBytes += pages[i].length;
+    }
+    resetPeakMemory();
+    double start = currentSeconds();
+    Build build = buildStylesheet(stylesheet, 0);
+    Validator validator = buildValidator(build.stylesheet, &build.cascade);
+    ValidationCounts counts = createValidationCounts(&validator);
+    for (int i = 0; i < options -> pages; i++) {
+      validateHtml(&validator, "page", pages[i].chars, pages[i].length, NULL, &counts);
+    }
+    recordStage(run, stage, pageBytes, currentSeconds() - start);
+    return;
+  }
+
+  char outputPath[] = "/tmp/kcss-bench-XXXXXX";
+  int descriptor = mkstemp(outputPath);
+  resetPeakMemory();
+  double start = currentSeconds();
+  Build build = buildStylesheet(stylesheet, 0);
+  emitStylesheet(outputPath, &build);
+  recordStage(run, stage, tokenStream -> length, currentSeconds() - start);
+  close(descriptor);
+  unlink(outputPath);
+}
+
+// [Bench]runBenchmarks
+// Benchmarks every stage at 1KB, 10KB and so on up to maxBytes, 100MB by
+// default, each stage of each size in a child process.
+int runBenchmarks(int argc, char const* argv[]) {
+  BenchRun run = {"unlabeled", "bench/results.tsv", 0};
+  GeneratorOptions options = defaultGeneratorOptions();
+  long maxBytes = 100L * 1024 * 1024;
+  for (int i = 2; i < argc; i++) {
+    if (readGeneratorOption(&options, argc, argv, i)) {
+      i++;
+    } else if (strcmp(argv[i], "--max-bytes") == 0 && i + 1 < argc) {
+      maxBytes = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+      run.label = argv[++i];
+    } else if (strcmp(argv[i], "--results") == 0 && i + 1 < argc) {
+      run.resultsPath = argv[++i];
+    }
+  }
+  if (strcmp(run.resultsPath, "bench/results.tsv") == 0) {
+    mkdir("bench", 0755);
+  }
+  const char* stages[] = {"read", "lex", "parse", "validate", "emit"};
+  printf("%10s  %-8s %11s %15s %13s\n", "bytes", "stage", "time", "throughput", "peak");
+  fflush(stdout);
+  for (long bytes = 1024; bytes <= maxBytes; bytes *= 10) {
+    run.bytes = bytes;
+    for (int i = 0; i < 5; i++) {
+      pid_t child = fork();
+      if (child == 0) {
+        benchStage(&run, &options, stages[i]);
+        exit(0);
+      }
+      int status;
+      waitpid(child, &status, 0);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("[error] %s benchmark at %ld bytes failed\n", stages[i], bytes);
+        return 1;
+      }
+    }
+  }
   return 0;
 }